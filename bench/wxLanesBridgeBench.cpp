@@ -0,0 +1,347 @@
+/*
+MIT License
+
+Copyright (c) 2026 Kritzel Kratzel for OneLuaPro
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Throughput and latency benchmark of wxLanesBridge.
+//
+// The bridge source is compiled into this executable, so bridge and benchmark
+// share one wxWidgets instance. The main thread plays the GUI thread of a
+// wxApp without event loop: it owns the "GUI" Lua state and drains the events
+// of a sink, a frame that is never shown (the bridge posts to windows, so a 
+// display is needed, e.g. xvfb-run on Linux). Each producer runs on its own 
+// std::thread with its own Lua state, which is what a Lanes lane amounts to,
+// and posts through the regular Lua API of the bridge.
+//
+// Usage: wxLanesBridgeBench [producers [records-per-producer [output.json]]]
+//
+// For every scenario the JSON result holds the records posted and those handed
+// out by bridge.getBatch (fewer for coalescing modes), the bridge events, 
+// records per second, latency percentiles in microseconds (from bridge.stats),
+// heap allocations per record (C++ and Lua allocators of all states) and the
+// GUI thread's CPU time per record.
+
+#include <lua.hpp>
+#include <wx/wx.h>
+#include <wx/init.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+extern "C" int luaopen_wxLanesBridge(lua_State* L);
+
+typedef std::chrono::steady_clock Clock;
+
+// ------------------------------------------------------------------------------
+// Allocation counting
+
+static std::atomic<unsigned long long> s_allocs(0);
+
+void* operator new(size_t size) {
+  s_allocs.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+static void* countingAlloc(void*, void* ptr, size_t, size_t nsize) {
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  s_allocs.fetch_add(1, std::memory_order_relaxed);
+  return realloc(ptr, nsize);
+}
+
+// CPU time of the calling thread in nanoseconds
+static long long threadCpuNs() {
+#ifdef _WIN32
+  FILETIME creation, exitTime, kernel, user;
+  GetThreadTimes(GetCurrentThread(), &creation, &exitTime, &kernel, &user);
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+  return (long long)(k.QuadPart + u.QuadPart) * 100;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// ------------------------------------------------------------------------------
+// Lua states
+
+static lua_State* newState() {
+  lua_State* L = lua_newstate(countingAlloc, NULL);
+  luaL_openlibs(L);
+  luaL_requiref(L, "wxLanesBridge", luaopen_wxLanesBridge, 0);
+  lua_pop(L, 1);
+  return L;
+}
+
+static void check(lua_State* L, int status) {
+  if (status != LUA_OK) {
+    fprintf(stderr, "wxLanesBridgeBench: %s\n", lua_tostring(L, -1));
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Runs chunk in L with the bridge module, the target pointer and the number of
+// records as arguments ("...")
+static void run(lua_State* L, const char* chunk, void* target, long long count) {
+  check(L, luaL_loadstring(L, chunk));
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "loaded");
+  lua_getfield(L, -1, "wxLanesBridge");
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+  lua_pushlightuserdata(L, target);
+  lua_pushinteger(L, count);
+  check(L, lua_pcall(L, 3, 0, 0));
+}
+
+// ------------------------------------------------------------------------------
+// Scenarios
+
+struct Scenario {
+  const char* name;
+  // Run once in the GUI state before the producers start (may be NULL)
+  const char* setup;
+  // Run in every producer state
+  const char* producer;
+  // Run once in the GUI state after all records are drained (may be NULL)
+  const char* teardown;
+  // Records may be coalesced, so fewer than posted are received
+  bool coalescing;
+};
+
+static const Scenario s_scenarios[] = {
+  { "postEvent", NULL,
+    "local bridge, t, n = ... for k = 1, n do bridge.postEvent(t) end", NULL, false },
+  { "postEvent_payload", NULL,
+    "local bridge, t, n = ... local d = { s = 'The quick brown fox', i = 0, l = 0 }\n"
+    "for k = 1, n do d.i = k bridge.postEvent(t, d) end", NULL, false },
+  { "post", NULL,
+    "local bridge, t, n = ... for k = 1, n do bridge.post(t, k, 0, 'The quick brown fox') end", NULL, false },
+  { "postv", NULL,
+    "local bridge, t, n = ... for k = 1, n do bridge.postv(t, 'sample', k, 0.25) end", NULL, false },
+  { "postEventBatch_64", NULL,
+    "local bridge, t, n = ... local b = {}\n"
+    "for k = 1, 64 do b[k] = { s = 'The quick brown fox', i = k } end\n"
+    "for k = 1, n, 64 do bridge.postEventBatch(t, b) end", NULL, false },
+  { "postLatest", NULL,
+    "local bridge, t, n = ... local d = { i = 0 }\n"
+    "for k = 1, n do d.i = k bridge.postLatest(t, 'progress', d) end", NULL, true },
+  { "paced_16ms",
+    "local bridge, t = ... bridge.configure(t, { interval = 16 })",
+    "local bridge, t, n = ... local d = { i = 0 }\n"
+    "for k = 1, n do d.i = k bridge.postEvent(t, d) end",
+    "local bridge, t = ... bridge.configure(t, {})", false },
+  { "ring",
+    "local bridge, t = ... RING = bridge.ring(t, 4096)",
+    NULL, // set up in main(), needs the ring handle
+    "local bridge = ... bridge.ringClose(RING) RING = nil", false },
+};
+
+static const char* s_ringProducer =
+  "local bridge, r, n = ... local d = { i = 0 }\n"
+  "for k = 1, n do d.i = k while not bridge.ringPush(r, d) do end end";
+
+// Consumer in the GUI state: counts the records of an event
+static const char* s_consumer =
+  "local bridge = ... return function(event) local _, n = bridge.getBatch(event) return n end";
+
+// Event sink, a hidden frame standing in for the target window
+class Sink : public wxFrame {
+public:
+  Sink(lua_State* L, int consumer) 
+    : wxFrame(NULL, wxID_ANY, wxT("wxLanesBridgeBench")), received(0), m_L(L), m_consumer(consumer) {
+    Bind(wxEVT_THREAD, &Sink::OnThread, this);
+  }
+  long long received;
+private:
+  void OnThread(wxThreadEvent& event) {
+    lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_consumer);
+    lua_pushlightuserdata(m_L, &event);
+    check(m_L, lua_pcall(m_L, 1, 1, 0));
+    received += lua_tointeger(m_L, -1);
+    lua_pop(m_L, 1);
+  }
+  lua_State* m_L;
+  int m_consumer;
+};
+
+// Returns field name of the table on top of the stack as a number
+static double field(lua_State* L, const char* name) {
+  lua_getfield(L, -1, name);
+  double value = lua_tonumber(L, -1);
+  lua_pop(L, 1);
+  return value;
+}
+
+int main(int argc, char** argv) {
+  int producers = argc > 1 ? atoi(argv[1]) : 4;
+  long long perProducer = argc > 2 ? atoll(argv[2]) : 100000;
+  FILE* out = argc > 3 ? fopen(argv[3], "w") : stdout;
+  if (producers < 1 || perProducer < 1 || !out) {
+    fprintf(stderr, "Usage: wxLanesBridgeBench [producers [records-per-producer [output.json]]]\n");
+    return EXIT_FAILURE;
+  }
+
+  // Application without event loop: provides the pending event processing
+  wxApp::SetInstance(new wxApp());
+  if (!wxEntryStart(argc, argv) || !wxTheApp->CallOnInit()) {
+    fprintf(stderr, "wxLanesBridgeBench: Failed to initialize wxWidgets.\n");
+    return EXIT_FAILURE;
+  }
+
+  // GUI state
+  lua_State* gui = newState();
+  lua_getglobal(gui, "package");
+  lua_getfield(gui, -1, "loaded");
+  lua_getfield(gui, -1, "wxLanesBridge");
+  lua_getfield(gui, -1, "init");
+  lua_pushinteger(gui, wxEVT_THREAD);
+  check(gui, lua_pcall(gui, 1, 0, 0));
+  lua_getfield(gui, -1, "enableStats");
+  lua_pushboolean(gui, 1);
+  check(gui, lua_pcall(gui, 1, 0, 0));
+  lua_pop(gui, 3);
+  check(gui, luaL_loadstring(gui, s_consumer));
+  lua_getglobal(gui, "package");
+  lua_getfield(gui, -1, "loaded");
+  lua_getfield(gui, -1, "wxLanesBridge");
+  lua_replace(gui, -3);
+  lua_pop(gui, 1);
+  check(gui, lua_pcall(gui, 1, 1, 0));
+  int consumer = luaL_ref(gui, LUA_REGISTRYINDEX);
+
+  fprintf(out, "{\n  \"producers\": %d,\n  \"recordsPerProducer\": %lld,\n  \"scenarios\": [\n",
+          producers, perProducer);
+  // One sink for all scenarios: it must outlive whatever the bridge still
+  // holds for it, e.g. the pacer timer of a paced target
+  Sink* sink = new Sink(gui, consumer);
+  void* target = static_cast<wxWindow*>(sink);
+  size_t count = sizeof(s_scenarios) / sizeof(s_scenarios[0]);
+  for (size_t n = 0; n < count; n++) {
+    const Scenario& sc = s_scenarios[n];
+    sink->received = 0;
+    run(gui, "local bridge = ... bridge.resetStats()", target, 0);
+    if (sc.setup) run(gui, sc.setup, target, 0);
+    void* producerTarget = target;
+    const char* producer = sc.producer;
+    if (!producer) {
+      lua_getglobal(gui, "RING");
+      producerTarget = lua_touserdata(gui, -1);
+      lua_pop(gui, 1);
+      producer = s_ringProducer;
+    }
+
+    // Producer states are created up front, so their setup is not measured
+    std::vector<lua_State*> states;
+    for (int p = 0; p < producers; p++) states.push_back(newState());
+    std::atomic<int> running(producers);
+    unsigned long long allocs0 = s_allocs.load();
+    long long cpu0 = threadCpuNs();
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+      lua_State* L = states[p];
+      threads.push_back(std::thread([L, producer, producerTarget, perProducer, &running] {
+        run(L, producer, producerTarget, perProducer);
+        running--;
+      }));
+    }
+
+    // GUI loop: drain until the producers are done, no event is in flight and
+    // every record has arrived (records of a paced target wait in its queue
+    // without an event). Idle rounds sleep briefly, so they do not count as 
+    // GUI CPU time.
+    for (;;) {
+      long long before = sink->received;
+      wxTheApp->ProcessPendingEvents();
+      if (sink->received == before) std::this_thread::sleep_for(std::chrono::microseconds(50));
+      if (running.load() > 0) continue;
+      lua_getglobal(gui, "package");
+      lua_getfield(gui, -1, "loaded");
+      lua_getfield(gui, -1, "wxLanesBridge");
+      lua_getfield(gui, -1, "stats");
+      check(gui, lua_pcall(gui, 0, 1, 0));
+      double inflight = field(gui, "inflight");
+      long long sent = (long long)field(gui, "records");
+      lua_pop(gui, 4);
+      if (inflight == 0 && (sc.coalescing || sink->received == sent)) break;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    long long cpu = threadCpuNs() - cpu0;
+    unsigned long long allocs = s_allocs.load() - allocs0;
+    for (size_t p = 0; p < threads.size(); p++) threads[p].join();
+
+    // Results
+    lua_getglobal(gui, "package");
+    lua_getfield(gui, -1, "loaded");
+    lua_getfield(gui, -1, "wxLanesBridge");
+    lua_getfield(gui, -1, "stats");
+    check(gui, lua_pcall(gui, 0, 1, 0));
+    double events = field(gui, "events");
+    long long posted = (long long)field(gui, "records");
+    lua_getfield(gui, -1, "latency");
+    double p50 = field(gui, "p50");
+    double p90 = field(gui, "p90");
+    double p99 = field(gui, "p99");
+    lua_pop(gui, 5);
+    if (sc.teardown) run(gui, sc.teardown, target, 0);
+    for (size_t p = 0; p < states.size(); p++) lua_close(states[p]);
+
+    fprintf(out,
+      "    { \"name\": \"%s\", \"posted\": %lld, \"received\": %lld, \"events\": %.0f,"
+      " \"seconds\": %.6f, \"recordsPerSec\": %.0f,"
+      " \"latencyUs\": { \"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f },"
+      " \"allocsPerRecord\": %.3f, \"guiCpuNsPerRecord\": %.1f, \"guiCpuShare\": %.3f }%s\n",
+      sc.name, posted, sink->received, events, seconds, posted / seconds, p50, p90, p99,
+      (double)allocs / posted, (double)cpu / posted, cpu / (seconds * 1e9),
+      n + 1 < count ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+  if (out != stdout) fclose(out);
+  // All records arrived, so the pacer holds nothing for the sink any more
+  delete sink;
+  lua_close(gui);
+  wxEntryCleanup();
+  return EXIT_SUCCESS;
+}
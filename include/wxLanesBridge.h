@@ -0,0 +1,70 @@
+/*
+MIT License
+
+Copyright (c) 2026 Kritzel Kratzel for OneLuaPro
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Plain C interface of the wxLanesBridge module.
+ *
+ * These functions are exported by the module library next to
+ * luaopen_wxLanesBridge. They do not take a lua_State, so C/C++ code running
+ * in lanes can post without going through Lua. The bridge must have been 
+ * initialized via bridge.init() in the GUI thread.
+ *
+ * The module library needs the Lua 5.4 C API of its host (on Windows it links
+ * against the Lua DLL, elsewhere the symbols are resolved from the host 
+ * executable), so it cannot be loaded into a LuaJIT process, e.g. via 
+ * ffi.load(). There is no Lua-independent build of these functions.
+ */
+
+#ifndef WXLANESBRIDGE_H
+#define WXLANESBRIDGE_H
+
+#include <stddef.h>
+
+#ifndef WXLANESBRIDGE_API
+#if defined(_WIN32)
+#define WXLANESBRIDGE_API __declspec(dllimport)
+#else
+#define WXLANESBRIDGE_API
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Same as bridge.post(target, i, l, s): posts an event with the int i, the
+ * extra long l and the string of len bytes at s (UTF-8, may be NULL for no
+ * string) to target, a window pointer or a handle from bridge.handle().
+ * Returns 1 if the event was queued, 0 if the handle is dead or a full queue
+ * dropped or rejected the data (see bridge.configure()), and -1 if target is
+ * NULL or the bridge has not been initialized.
+ */
+WXLANESBRIDGE_API int wxLanesBridge_post(void* target, int i, long l, const char* s, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WXLANESBRIDGE_H */
@@ -52,195 +52,6402 @@ SOFTWARE.
 
 #include <lua.hpp>
 #include <wx/wx.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #define _VERSION "wxLanesBridge 1.0"
-wxEventType s_defaultEventID = wxID_ANY;
+
+// Export of the module entry point and of the C interface (wxLanesBridge.h).
+// On Windows, LUA_API is dllexport (built with LUA_BUILD_AS_DLL and LUA_LIB). 
+// Elsewhere LUA_API is a plain "extern", which cannot follow extern "C", and 
+// the module is built with hidden symbols.
+#if defined(_WIN32)
+#define WXLANESBRIDGE_API LUA_API
+#else
+#define WXLANESBRIDGE_API __attribute__((visibility("default")))
+#endif
+#include "wxLanesBridge.h"
+
+// Event type of bridge.init(), wxID_ANY before. Stored last by init() with
+// release semantics, so a lane seeing it also sees the rest of the init state.
+static std::atomic<wxEventType> s_defaultEventID(wxID_ANY);
+typedef std::chrono::steady_clock Clock;
+
+// Set by bridge.flush() and bridge.shutdown(): all posts are ignored from then
+// on. s_posting counts the posts under way (see PostGuard).
+static std::atomic<bool> s_closed(false);
+static std::atomic<int> s_posting(0);
+
+// ------------------------------------------------------------------------------
+// Internal event payloads
+
+// Base class of all objects shared between threads. Starts with one reference
+// owned by the creator.
+class RefCounted {
+public:
+  RefCounted() : m_refs(1) {}
+  virtual ~RefCounted() {}
+  void addRef() { m_refs.fetch_add(1, std::memory_order_relaxed); }
+  void release() {
+    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) dispose();
+  }
+protected:
+  // Called when the last reference is gone. Pooled classes recycle the object.
+  virtual void dispose() { delete this; }
+private:
+  template <class T> friend class Recycler;
+  std::atomic<int> m_refs;
+};
+
+// Thread-safe free list of equally sized memory blocks. Blocks are taken from
+// the list when available (a hit) and from the heap otherwise (a miss). At most
+// maxFree blocks are kept for reuse.
+class BlockPool {
+public:
+  BlockPool(size_t blockSize, size_t maxFree)
+    : hits(0), misses(0), m_blockSize(blockSize), m_maxFree(maxFree) {
+    m_free.reserve(maxFree);
+  }
+  void* alloc(size_t size) {
+    if (size == m_blockSize) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_free.empty()) {
+        void* block = m_free.back();
+        m_free.pop_back();
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return block;
+      }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+  }
+  void free(void* block, size_t size) {
+    if (size == m_blockSize) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_free.size() < m_maxFree) {
+        m_free.push_back(block);
+        return;
+      }
+    }
+    ::operator delete(block);
+  }
+  size_t available() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_free.size();
+  }
+  std::atomic<unsigned long long> hits;
+  std::atomic<unsigned long long> misses;
+private:
+  const size_t m_blockSize;
+  const size_t m_maxFree;
+  std::mutex m_mutex;
+  std::vector<void*> m_free;
+};
+
+// Maximum number of recycled objects kept per pool
+#define POOL_SIZE 4096
+
+// Free list of recycled RefCounted objects of class T. Unlike a BlockPool it 
+// keeps the objects constructed, so members like vectors and strings keep 
+// their capacity.
+template <class T> class Recycler {
+public:
+  Recycler() : hits(0), misses(0) { m_free.reserve(POOL_SIZE); }
+  T* create() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_free.empty()) {
+        T* obj = m_free.back();
+        m_free.pop_back();
+        obj->m_refs.store(1, std::memory_order_relaxed);
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return obj;
+      }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return new T();
+  }
+  // Takes back obj (to be called from its dispose())
+  void recycle(T* obj) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_free.size() < POOL_SIZE) {
+        m_free.push_back(obj);
+        return;
+      }
+    }
+    delete obj;
+  }
+  size_t available() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_free.size();
+  }
+  std::atomic<unsigned long long> hits;
+  std::atomic<unsigned long long> misses;
+private:
+  std::mutex m_mutex;
+  std::vector<T*> m_free;
+};
+
+// Owning pointer to a RefCounted object. The constructor taking a raw pointer
+// adopts the caller's reference.
+template <class T> class Ref {
+public:
+  Ref() : m_ptr(NULL) {}
+  explicit Ref(T* ptr) : m_ptr(ptr) {}
+  Ref(const Ref& other) : m_ptr(other.m_ptr) { if (m_ptr) m_ptr->addRef(); }
+  Ref(Ref&& other) : m_ptr(other.m_ptr) { other.m_ptr = NULL; }
+  ~Ref() { if (m_ptr) m_ptr->release(); }
+  Ref& operator=(Ref other) { std::swap(m_ptr, other.m_ptr); return *this; }
+  T* get() const { return m_ptr; }
+  T* operator->() const { return m_ptr; }
+  void reset() { Ref().swap(*this); }
+  void swap(Ref& other) { std::swap(m_ptr, other.m_ptr); }
+private:
+  T* m_ptr;
+};
+
+// Bridge-owned binary buffer, handed from lanes to the GUI thread without
+// copying (see bridge.buffer)
+class Buffer : public RefCounted {
+public:
+  Buffer(unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+  virtual ~Buffer() { free(m_data); }
+  // Returns a new buffer of the given size or NULL if out of memory
+  static Buffer* create(size_t size) {
+    unsigned char* data = (unsigned char*)malloc(size ? size : 1);
+    return data ? new Buffer(data, size) : NULL;
+  }
+  unsigned char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+private:
+  unsigned char* m_data;
+  size_t m_size;
+};
+
+// One data record as carried across the bridge. The fields mirror the s/i/l 
+// members of a wxThreadEvent, but the string is kept as raw UTF-8 bytes so it 
+// can be handed back to Lua without any wxString round trip.
+struct Record {
+  Record() : i(0), l(0), hasS(false), hasB(false), compressed(0) {}
+  std::string s;
+  int i;
+  long l;
+  bool hasS;
+  std::string b; // raw bytes of data.b, never converted
+  bool hasB;
+  std::string k; // coalescing key of bridge.postLatest(), empty if none
+  Ref<Buffer> buffer; // attached binary buffer, if any
+  std::string value; // packed data.value (see packValue), empty if none
+  int compressed; // COMPRESSED_S and/or COMPRESSED_B if s or b hold compressed data
+};
+
+// Flags of Record::compressed
+enum { COMPRESSED_S = 1, COMPRESSED_B = 2 };
+
+// Reference-counted data block attached to a BridgeEvent. The payload is shared
+// (not copied) when wxWidgets clones the event for its pending-event queue.
+class Payload : public RefCounted {
+public:
+  // Appends the payload's records to the table on top of the Lua stack, 
+  // starting at index n+1. Returns the new number of table entries.
+  virtual int pushRecords(lua_State* L, int n) = 0;
+};
+
+// Payload of bridge.postEventBatch(): a plain list of records. Payloads are
+// recycled together with the capacity of their record vector.
+class BatchPayload : public Payload {
+public:
+  static BatchPayload* create() { return recycler().create(); }
+  static Recycler<BatchPayload>& recycler() {
+    // Never destroyed: payloads may outlive the static data of this module
+    static Recycler<BatchPayload>* s_recycler = new Recycler<BatchPayload>();
+    return *s_recycler;
+  }
+  std::vector<Record> records;
+  virtual int pushRecords(lua_State* L, int n);
+protected:
+  virtual void dispose() {
+    records.clear(); // keeps the vector's capacity
+    recycler().recycle(this);
+  }
+};
+
+// Maximum number of values of bridge.postv()
+#define MAX_VALUES 16
+
+// One value of bridge.postv()
+struct Value {
+  int type; // LUA_TNIL, LUA_TBOOLEAN, LUA_TNUMBER (see isInt), LUA_TSTRING or LUA_TLIGHTUSERDATA
+  bool isInt;
+  union {
+    lua_Integer i;
+    lua_Number d;
+    void* p;
+  };
+  std::string s;
+};
+
+// Payload of bridge.postv(): a fixed-layout array of values. Payloads are 
+// recycled together with the capacity of their strings.
+class ValuesPayload : public Payload {
+public:
+  ValuesPayload() : count(0) {}
+  static ValuesPayload* create() { return recycler().create(); }
+  static Recycler<ValuesPayload>& recycler() {
+    static Recycler<ValuesPayload>* s_recycler = new Recycler<ValuesPayload>();
+    return *s_recycler;
+  }
+  // Reads the Lua values at stack indices first to last and returns their size
+  // in bytes. Must not raise Lua errors (the caller has checked the types).
+  size_t read(lua_State* L, int first, int last);
+  // Pushes all values onto the Lua stack and returns their number
+  int pushValues(lua_State* L);
+  // Pushes one record with the values at indices 1..n and the field n
+  virtual int pushRecords(lua_State* L, int n);
+  int count;
+  Value values[MAX_VALUES];
+protected:
+  virtual void dispose() {
+    count = 0;
+    recycler().recycle(this);
+  }
+};
+
+// ------------------------------------------------------------------------------
+// Object handles
+
+// Handles of the bridge objects lanes work with (buffers, rings, mailboxes, 
+// ...) are lightuserdata values with bit 1 set and bit 0 clear, so they are 
+// no window handles (see HandleRegistry) and no object addresses. The other 
+// bits hold a slot index and the generation of the slot when the handle was 
+// issued. Closing advances the generation, so a closed handle is dead and 
+// never reaches freed memory; the object itself lives on while references to
+// it exist. Each slot also records the object type, so a handle of one type 
+// is no valid handle of another.
+#define OBJECT_INDEX_BITS 16
+#define OBJECT_CHUNK_BITS 10
+#define MAX_OBJECTS (1 << OBJECT_INDEX_BITS)
+#define OBJECT_CHUNK_SIZE (1 << OBJECT_CHUNK_BITS)
+#define OBJECT_GEN_MASK (UINTPTR_MAX >> (OBJECT_INDEX_BITS + 2))
+
+// Types of object handles
+enum {
+  OBJECT_BUFFER = 1, OBJECT_RING, OBJECT_MAILBOX, OBJECT_LOG, OBJECT_ARRAY, OBJECT_WORKERS,
+  OBJECT_FUTURE
+};
+
+struct ObjectSlot {
+  ObjectSlot() : gen(0), users(0), index(0), type(0), obj(NULL) {}
+  std::atomic<uintptr_t> gen; // odd while the slot is live
+  std::atomic<int> users; // functions currently looking at obj
+  size_t index;
+  int type;
+  RefCounted* obj;
+};
+
+// Registry of object handles. Slots are allocated in chunks as needed, 
+// lookups are lock-free. Never destroyed: lanes may still hold handles when 
+// the DLL unloads.
+class ObjectRegistry {
+public:
+  ObjectRegistry() : m_used(0) {
+    for (size_t n = 0; n < MAX_OBJECTS / OBJECT_CHUNK_SIZE; n++) m_chunks[n].store(NULL);
+  }
+  // Takes the reference of obj. Returns its handle, NULL if all slots are in use.
+  void* add(RefCounted* obj, int type) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t idx;
+    if (!m_free.empty()) {
+      idx = m_free.back();
+      m_free.pop_back();
+    }
+    else if (m_used < MAX_OBJECTS) {
+      idx = m_used++;
+      if (!(idx & (OBJECT_CHUNK_SIZE - 1))) {
+        ObjectSlot* chunk = new ObjectSlot[OBJECT_CHUNK_SIZE];
+        for (size_t n = 0; n < OBJECT_CHUNK_SIZE; n++) chunk[n].index = idx + n;
+        m_chunks[idx >> OBJECT_CHUNK_BITS].store(chunk);
+      }
+    }
+    else {
+      return NULL;
+    }
+    ObjectSlot& slot = m_chunks[idx >> OBJECT_CHUNK_BITS].load()[idx & (OBJECT_CHUNK_SIZE - 1)];
+    slot.obj = obj;
+    slot.type = type;
+    uintptr_t gen = slot.gen.load() + 1;
+    slot.gen.store(gen); // publishes obj and type
+    return (void*)(((((gen & OBJECT_GEN_MASK) << OBJECT_INDEX_BITS) | idx) << 2) | 2);
+  }
+  // Kills handle and returns the reference of its object, NULL if the handle
+  // is dead or of another type. Waits until no function looks at the object 
+  // via the handle.
+  RefCounted* remove(void* handle, int type) {
+    uintptr_t gen;
+    ObjectSlot* slot = find(handle, type, gen);
+    if (!slot) return NULL;
+    uintptr_t expected = gen;
+    // Only one caller wins the race of closing the same handle twice
+    while (!slot->gen.compare_exchange_weak(expected, gen + 1)) {
+      if ((expected & OBJECT_GEN_MASK) != (gen & OBJECT_GEN_MASK)) return NULL;
+    }
+    while (slot->users.load() != 0) std::this_thread::yield();
+    RefCounted* obj = slot->obj;
+    slot->obj = NULL;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(slot->index);
+    return obj;
+  }
+  // Returns the slot of a live handle of the given type, with its users 
+  // counter incremented, or NULL
+  ObjectSlot* use(void* handle, int type) {
+    uintptr_t gen;
+    ObjectSlot* slot = find(handle, type, gen);
+    if (!slot) return NULL;
+    slot->users.fetch_add(1);
+    if (slot->gen.load() != gen) {
+      slot->users.fetch_sub(1);
+      return NULL;
+    }
+    return slot;
+  }
+private:
+  // Returns the slot of a handle and the full generation of a live slot in 
+  // gen, NULL if handle is no live handle of the given type
+  ObjectSlot* find(void* handle, int type, uintptr_t& gen) {
+    uintptr_t value = (uintptr_t)handle;
+    if ((value & 3) != 2) return NULL;
+    value >>= 2;
+    size_t idx = value & (MAX_OBJECTS - 1);
+    ObjectSlot* chunk = m_chunks[idx >> OBJECT_CHUNK_BITS].load();
+    if (!chunk) return NULL;
+    ObjectSlot* slot = &chunk[idx & (OBJECT_CHUNK_SIZE - 1)];
+    gen = slot->gen.load();
+    if ((gen & OBJECT_GEN_MASK) != (value >> OBJECT_INDEX_BITS)) return NULL;
+    return slot->type == type ? slot : NULL;
+  }
+  std::mutex m_mutex;
+  std::atomic<ObjectSlot*> m_chunks[MAX_OBJECTS / OBJECT_CHUNK_SIZE];
+  std::vector<size_t> m_free;
+  size_t m_used;
+};
+
+static ObjectRegistry& objects() {
+  static ObjectRegistry* s_objects = new ObjectRegistry();
+  return *s_objects;
+}
+
+// Holds the object behind a handle of type T while it exists. Closing the 
+// handle waits until the holder is gone, so no Lua error may be raised while
+// holding it. A function that may raise or wait takes a reference instead 
+// (see acquire()).
+template <class T> class ObjectUse {
+public:
+  ObjectUse(void* handle, int type) : m_slot(objects().use(handle, type)) {}
+  ~ObjectUse() { if (m_slot) m_slot->users.fetch_sub(1); }
+  T* get() const { return m_slot ? static_cast<T*>(m_slot->obj) : NULL; }
+private:
+  ObjectUse(const ObjectUse&);
+  ObjectUse& operator=(const ObjectUse&);
+  ObjectSlot* m_slot;
+};
+
+// Returns a new reference to the object behind a live handle, NULL if the 
+// handle is dead or of another type
+template <class T> static T* acquire(void* handle, int type) {
+  ObjectUse<T> use(handle, type);
+  if (use.get()) use.get()->addRef();
+  return use.get();
+}
+
+// Kills a handle and returns the reference it held, NULL if it was dead
+template <class T> static T* removeObject(void* handle, int type) {
+  return static_cast<T*>(objects().remove(handle, type));
+}
+
+// ------------------------------------------------------------------------------
+// Instrumentation
+
+// Number of latency histogram buckets. Bucket n counts latencies below 2^n 
+// microseconds (and at least 2^(n-1) for n > 0); the last bucket takes the rest.
+#define LATENCY_BUCKETS 32
+
+// Kinds of trace records (see bridge.enableTrace)
+enum { TRACE_POST, TRACE_QUEUED, TRACE_BATCH, TRACE_DRAIN };
+static const char* const s_traceNames[] = { "post", "queued", "getBatch", "drain" };
+
+// Trace record: an instant if dur is negative, a span otherwise
+struct TraceRecord {
+  Clock::time_point start;
+  long long dur; // in nanoseconds
+  void* target;
+  unsigned long long size; // bytes of a post, records of a batch or drain
+  int kind;
+};
+
+// Trace records of one thread. Only the owning thread appends, so the lock is
+// uncontended except while bridge.dumpTrace() collects the records. The 
+// buffers are never freed: threads may still write while the DLL unloads.
+struct TraceBuffer {
+  TraceBuffer(unsigned tid, bool gui) : tid(tid), gui(gui), lost(0) {}
+  std::mutex mutex;
+  std::vector<TraceRecord> records;
+  const unsigned tid; // sequential id for the trace file
+  const bool gui; // GUI thread
+  unsigned long long lost; // records not stored because the buffer was full
+};
+
+// Tracing state. While disabled, tracing costs a single relaxed load and branch 
+// at each trace point.
+static std::atomic<bool> s_tracing(false);
+static std::mutex s_traceMutex;
+static std::vector<TraceBuffer*> s_traceBuffers;
+static std::atomic<size_t> s_traceCapacity(0); // records per thread
+static Clock::time_point s_traceEpoch;
+static thread_local TraceBuffer* t_traceBuffer = NULL;
+// Thread that called bridge.init(): the GUI thread, which must never block
+static std::thread::id s_guiThread;
+
+static void traceRecord(int kind, void* target, unsigned long long size, 
+                        Clock::time_point start, long long dur) {
+  TraceBuffer* buffer = t_traceBuffer;
+  if (!buffer) {
+    std::lock_guard<std::mutex> lock(s_traceMutex);
+    buffer = new TraceBuffer((unsigned)s_traceBuffers.size() + 1, std::this_thread::get_id() == s_guiThread);
+    s_traceBuffers.push_back(buffer);
+    t_traceBuffer = buffer;
+  }
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  if (buffer->records.size() >= s_traceCapacity.load(std::memory_order_relaxed)) {
+    buffer->lost++;
+    return;
+  }
+  TraceRecord rec = { start, dur, target, size, kind };
+  buffer->records.push_back(rec);
+}
+
+#define TRACING() (s_tracing.load(std::memory_order_relaxed))
+
+// Records an instant
+static void trace(int kind, void* target, unsigned long long size) {
+  if (!TRACING()) return;
+  traceRecord(kind, target, size, Clock::now(), -1);
+}
+
+// Records a span from start until now. A default start means tracing was 
+// disabled when the span began.
+static void traceSpan(int kind, void* target, unsigned long long size, Clock::time_point start) {
+  if (!TRACING() || start == Clock::time_point()) return;
+  Clock::time_point now = Clock::now();
+  traceRecord(kind, target, size, start, 
+              std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+}
+
+// Counters per target object
+struct TargetStats {
+  TargetStats() : events(0), handled(0), records(0), bytes(0), dropped(0) {}
+  unsigned long long events;
+  unsigned long long handled;
+  unsigned long long records;
+  unsigned long long bytes;
+  unsigned long long dropped;
+};
+
+// Bridge-wide counters. The global event counters are always maintained; 
+// per-target counters and post-to-handle latencies (which need a clock read per
+// event) only while enabled via bridge.enableStats().
+class Stats {
+public:
+  Stats() : enabled(false), events(0), handled(0), records(0), bytes(0), dropped(0) {
+    for (int n = 0; n < LATENCY_BUCKETS; n++) latency[n].store(0);
+  }
+  // Counts records sent to win (whether or not they get an event of their own)
+  void posted(void* win, unsigned long long count, unsigned long long size) {
+    records.fetch_add(count, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    trace(TRACE_POST, win, size);
+    if (!enabled.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    TargetStats& target = targets[win];
+    target.records += count;
+    target.bytes += size;
+  }
+  // Counts an event queued for win. Returns true if its latency is tracked.
+  bool queued(void* win) {
+    events.fetch_add(1, std::memory_order_relaxed);
+    if (!enabled.load(std::memory_order_relaxed)) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    targets[win].events++;
+    return true;
+  }
+  // Counts a record of win dropped or rejected by a full queue
+  void drop(void* win) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    if (!enabled.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    targets[win].dropped++;
+  }
+  // Counts an event handled by the GUI thread. If postTime is given, the
+  // latency since then is added to the histogram.
+  void done(void* win, const Clock::time_point* postTime) {
+    handled.fetch_add(1, std::memory_order_relaxed);
+    if (!postTime) return;
+    long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - *postTime).count();
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && us >= (1LL << bucket)) bucket++;
+    latency[bucket].fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex);
+    targets[win].handled++;
+  }
+  void reset() {
+    events.store(0);
+    handled.store(0);
+    records.store(0);
+    bytes.store(0);
+    dropped.store(0);
+    for (int n = 0; n < LATENCY_BUCKETS; n++) latency[n].store(0);
+    std::lock_guard<std::mutex> lock(mutex);
+    targets.clear();
+  }
+  std::atomic<bool> enabled;
+  std::atomic<unsigned long long> events;
+  std::atomic<unsigned long long> handled;
+  std::atomic<unsigned long long> records;
+  std::atomic<unsigned long long> bytes;
+  std::atomic<unsigned long long> dropped;
+  std::atomic<unsigned long long> latency[LATENCY_BUCKETS];
+  std::mutex mutex;
+  std::map<void*, TargetStats> targets;
+};
+
+static Stats& stats() {
+  // Never destroyed: events may outlive the static data of this module
+  static Stats* s_stats = new Stats();
+  return *s_stats;
+}
+
+// Size of the data carried by rec
+static size_t recordBytes(const Record& rec) {
+  return rec.s.size() + rec.b.size() + rec.value.size() + 
+    (rec.buffer.get() ? rec.buffer->size() : 0);
+}
+
+// wxThreadEvent carrying an optional Payload. Everything set via the regular 
+// wxThreadEvent setters still works, so wxLua handlers see a normal wxThreadEvent.
+class BridgeEvent : public wxThreadEvent {
+public:
+  // Takes over one reference of payload (which may be NULL)
+  BridgeEvent(wxEventType eventType, Payload* payload)
+    : wxThreadEvent(eventType, wxID_ANY), m_payload(payload), 
+      m_target(NULL), m_compressed(0), m_queued(false), m_timed(false), m_traced(false) {}
+  BridgeEvent(const BridgeEvent& other)
+    : wxThreadEvent(other), m_payload(other.m_payload), m_buffer(other.m_buffer),
+      m_bytes(other.m_bytes), m_value(other.m_value), m_text(other.m_text),
+      m_target(other.m_target), m_compressed(other.m_compressed), 
+      m_queued(false), m_timed(false), m_traced(false) {
+    if (m_payload) m_payload->addRef();
+  }
+  virtual ~BridgeEvent() {
+    MarkHandled();
+    if (m_payload) m_payload->release();
+  }
+  virtual wxEvent* Clone() const { return new BridgeEvent(*this); }
+  // Events are allocated from a pool and recycled when wxWidgets deletes them
+  // after processing (the deleting destructor lives in this module).
+  static void* operator new(size_t size) { return pool().alloc(size); }
+  static void operator delete(void* block, size_t size) { pool().free(block, size); }
+  static BlockPool& pool() {
+    // Never destroyed: events may outlive the static data of this module
+    static BlockPool* s_pool = new BlockPool(sizeof(BridgeEvent), POOL_SIZE);
+    return *s_pool;
+  }
+  Payload* GetPayload() const { return m_payload; }
+  // Binary buffer of bridge.postEvent(), shared by all copies of the event
+  void SetBuffer(const Ref<Buffer>& buffer) { m_buffer = buffer; }
+  const Ref<Buffer>& GetBuffer() const { return m_buffer; }
+  // Raw bytes (data.b) of bridge.postEvent(), shared by all copies of the event
+  void SetBytes(const Ref<Buffer>& bytes) { m_bytes = bytes; }
+  const Ref<Buffer>& GetBytes() const { return m_bytes; }
+  // Compressed string (data.s) of bridge.postEvent(), set instead of the 
+  // event string; shared by all copies of the event
+  void SetText(const Ref<Buffer>& text) { m_text = text; }
+  const Ref<Buffer>& GetText() const { return m_text; }
+  // COMPRESSED_S and/or COMPRESSED_B if text or bytes hold compressed data
+  void SetCompressed(int compressed) { m_compressed = compressed; }
+  int GetCompressed() const { return m_compressed; }
+  // Packed value (data.value) of bridge.postEvent(), shared by all copies of the event
+  void SetValue(const Ref<Buffer>& value) { m_value = value; }
+  const Ref<Buffer>& GetValue() const { return m_value; }
+  // Target object; set when the event is queued
+  wxWindow* GetTarget() const { return m_target; }
+  // Statistics: called when the event is handed over to the target's queue, 
+  // and when it has been handled (explicitly, or at the latest when deleted)
+  void MarkQueued(wxWindow* win) {
+    m_target = win;
+    m_queued = true;
+    m_timed = stats().queued(win);
+    m_traced = TRACING();
+    if (m_timed || m_traced) m_postTime = Clock::now();
+  }
+  void MarkHandled() {
+    if (!m_queued) return;
+    m_queued = false;
+    stats().done(m_target, m_timed ? &m_postTime : NULL);
+    if (m_traced) traceSpan(TRACE_QUEUED, m_target, 0, m_postTime);
+  }
+private:
+  BridgeEvent& operator=(const BridgeEvent&); // not assignable
+  Payload* m_payload;
+  Ref<Buffer> m_buffer;
+  Ref<Buffer> m_bytes;
+  Ref<Buffer> m_value;
+  Ref<Buffer> m_text;
+  wxWindow* m_target;
+  int m_compressed;
+  Clock::time_point m_postTime;
+  bool m_queued;
+  bool m_timed;
+  bool m_traced;
+};
+
+// Converts UTF-8 bytes to a wxString. Pure ASCII (the common case for status
+// strings) takes the cheaper FromAscii() path. Bytes that are not valid UTF-8 
+// are taken as Latin-1 instead of silently yielding an empty string.
+static wxString toWxString(const char* str, size_t len) {
+  for (size_t n = 0; n < len; n++) {
+    if ((unsigned char)str[n] & 0x80) {
+      wxString utf8 = wxString::FromUTF8(str, len);
+      if (utf8.empty()) return wxString(str, wxConvISO8859_1, len);
+      return utf8;
+    }
+  }
+  return wxString::FromAscii(str, len);
+}
+
+// Hands event over to the pending-event queue of win. Unlike wxPostEvent(),
+// which queues a Clone() of its argument, this passes the pooled event itself
+// and saves a second allocation plus a deep copy of the event string.
+static void queueEvent(wxWindow* win, BridgeEvent* event) {
+  event->MarkQueued(win);
+  win->QueueEvent(event);
+}
+
+// Metatable name of the GUI-side buffer views
+#define BUFFER_VIEW "wxLanesBridge.BufferView"
+#define TARGET_GROUP "wxLanesBridge.Group"
+#define POSTER "wxLanesBridge.Poster"
+
+// Upvalues of the module functions (see luaopen_wxLanesBridge): the module 
+// table and the field names of data tables. Pushing a cached key saves 
+// hashing the C string on every field lookup of the posting functions.
+enum {
+  UPVALUE_MODULE = 1, UPVALUE_S, UPVALUE_I, UPVALUE_L, UPVALUE_B, UPVALUE_VALUE, UPVALUE_BUFFER,
+  UPVALUE_COMPRESS, UPVALUE_COUNT = UPVALUE_COMPRESS
+};
+static const char* const s_fieldNames[] = { "s", "i", "l", "b", "value", "buffer", "compress" };
+
+// Pushes the upvalues of the module functions, with the module table at idx
+static void pushUpvalues(lua_State* L, int idx) {
+  lua_pushvalue(L, idx);
+  for (int n = UPVALUE_S; n <= UPVALUE_COUNT; n++) {
+    lua_pushstring(L, s_fieldNames[n - UPVALUE_S]);
+  }
+}
+
+// Same as lua_getfield() for the data table at (positive) index idx, with the
+// cached key of upvalue key
+static int getField(lua_State* L, int idx, int key) {
+  lua_pushvalue(L, lua_upvalueindex(key));
+  return lua_gettable(L, idx);
+}
+
+// Pushes a userdata view of buffer, keeping the buffer alive until the view
+// is garbage-collected
+static void pushBufferView(lua_State* L, const Ref<Buffer>& buffer) {
+  Buffer** view = (Buffer**)lua_newuserdata(L, sizeof(Buffer*));
+  *view = buffer.get();
+  buffer->addRef();
+  luaL_setmetatable(L, BUFFER_VIEW);
+}
+
+// Refers to the buffer handle in field "buffer" of the table at index idx. 
+// Every post takes a reference of its own, so the caller keeps the handle 
+// whatever becomes of the post, and may post it again. Raises a Lua error if
+// the field holds no live buffer handle.
+static void readBuffer(lua_State* L, int idx, Ref<Buffer>& buffer) {
+  if (getField(L, idx, UPVALUE_BUFFER) == LUA_TNIL) {
+    lua_pop(L, 1);
+    return;
+  }
+  Buffer* buf = lua_islightuserdata(L, -1) ? acquire<Buffer>(lua_touserdata(L, -1), OBJECT_BUFFER) : NULL;
+  if (!buf) {
+    luaL_error(L, "wxLanesBridge: Field 'buffer' must be a live buffer handle (see bridge.buffer).");
+  }
+  Ref<Buffer>(buf).swap(buffer);
+  lua_pop(L, 1);	// pops the buffer handle
+}
+
+// ------------------------------------------------------------------------------
+// Binary serialization of Lua values
+
+// Tags of the packed format. Integers are stored as zigzag varints, floats and
+// pointers as raw 8 bytes, strings as varint length plus bytes. A table is its
+// array part (varint count plus values) followed by key/value pairs up to 
+// PACK_END.
+enum {
+  PACK_NIL, PACK_FALSE, PACK_TRUE, PACK_INT, PACK_FLOAT,
+  PACK_STRING, PACK_TABLE, PACK_END, PACK_POINTER
+};
+// Maximum table nesting; also stops cyclic tables
+#define PACK_MAX_DEPTH 100
+
+static void packVarint(std::string& out, unsigned long long v) {
+  while (v >= 0x80) {
+    out += (char)(v | 0x80);
+    v >>= 7;
+  }
+  out += (char)v;
+}
+
+// Appends the packed form of the value at index idx to out
+static void packValue(lua_State* L, int idx, std::string& out, int depth = 0) {
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+      out += (char)PACK_NIL;
+      break;
+    case LUA_TBOOLEAN:
+      out += (char)(lua_toboolean(L, idx) ? PACK_TRUE : PACK_FALSE);
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, idx)) {
+        lua_Integer v = lua_tointeger(L, idx);
+        out += (char)PACK_INT;
+        packVarint(out, ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63));
+      }
+      else {
+        double v = (double)lua_tonumber(L, idx);
+        out += (char)PACK_FLOAT;
+        out.append((const char*)&v, sizeof(v));
+      }
+      break;
+    case LUA_TSTRING: {
+      size_t len;
+      const char* str = lua_tolstring(L, idx, &len);
+      out += (char)PACK_STRING;
+      packVarint(out, len);
+      out.append(str, len);
+      break;
+    }
+    case LUA_TLIGHTUSERDATA: {
+      unsigned long long v = (unsigned long long)(uintptr_t)lua_touserdata(L, idx);
+      out += (char)PACK_POINTER;
+      out.append((const char*)&v, sizeof(v));
+      break;
+    }
+    case LUA_TTABLE: {
+      if (depth >= PACK_MAX_DEPTH) {
+        luaL_error(L, "wxLanesBridge: Table nesting too deep (or cyclic) to pack.");
+      }
+      luaL_checkstack(L, 3, "table too deep to pack");
+      idx = lua_absindex(L, idx);
+      out += (char)PACK_TABLE;
+      size_t count = (size_t)lua_rawlen(L, idx);
+      packVarint(out, count);
+      for (size_t n = 1; n <= count; n++) {
+        lua_rawgeti(L, idx, (lua_Integer)n);
+        packValue(L, -1, out, depth + 1);
+        lua_pop(L, 1);
+      }
+      lua_pushnil(L);
+      while (lua_next(L, idx)) {
+        // Skip the array part packed above
+        if (lua_isinteger(L, -2)) {
+          lua_Integer key = lua_tointeger(L, -2);
+          if (key >= 1 && (size_t)key <= count) {
+            lua_pop(L, 1);
+            continue;
+          }
+        }
+        packValue(L, -2, out, depth + 1);
+        packValue(L, -1, out, depth + 1);
+        lua_pop(L, 1);	// pops the value, keeps the key for lua_next()
+      }
+      out += (char)PACK_END;
+      break;
+    }
+    default:
+      luaL_error(L, "wxLanesBridge: Cannot pack values of type %s.", luaL_typename(L, idx));
+  }
+}
+
+// Packs the value at index idx into a per-thread scratch string, which keeps
+// its capacity across calls (and is not leaked if packing raises an error).
+static const std::string& packScratch(lua_State* L, int idx) {
+  static thread_local std::string s_scratch;
+  s_scratch.clear();
+  packValue(L, idx, s_scratch);
+  return s_scratch;
+}
+
+// Reads values of the packed format and pushes them onto a Lua stack
+class Unpacker {
+public:
+  Unpacker(lua_State* L, const char* data, size_t size)
+    : m_L(L), m_pos((const unsigned char*)data), m_end((const unsigned char*)data + size) {}
+  // Pushes the next value
+  void value(int depth = 0) {
+    int tag = byte();
+    switch (tag) {
+      case PACK_NIL: lua_pushnil(m_L); break;
+      case PACK_FALSE: lua_pushboolean(m_L, 0); break;
+      case PACK_TRUE: lua_pushboolean(m_L, 1); break;
+      case PACK_INT: {
+        unsigned long long v = varint();
+        lua_pushinteger(m_L, (lua_Integer)((v >> 1) ^ (~(v & 1) + 1)));
+        break;
+      }
+      case PACK_FLOAT: {
+        double v;
+        raw(&v, sizeof(v));
+        lua_pushnumber(m_L, (lua_Number)v);
+        break;
+      }
+      case PACK_STRING: {
+        unsigned long long len = varint();
+        need(len);
+        lua_pushlstring(m_L, (const char*)m_pos, (size_t)len);
+        m_pos += len;
+        break;
+      }
+      case PACK_POINTER: {
+        unsigned long long v;
+        raw(&v, sizeof(v));
+        lua_pushlightuserdata(m_L, (void*)(uintptr_t)v);
+        break;
+      }
+      case PACK_TABLE: {
+        if (depth >= PACK_MAX_DEPTH) corrupt();
+        luaL_checkstack(m_L, 3, "table too deep to unpack");
+        unsigned long long count = varint();
+        if (count > (unsigned long long)(m_end - m_pos)) corrupt(); // at least 1 byte per value
+        lua_createtable(m_L, (int)count, 0);
+        for (unsigned long long n = 1; n <= count; n++) {
+          value(depth + 1);
+          lua_rawseti(m_L, -2, (lua_Integer)n);
+        }
+        while (peek() != PACK_END) {
+          value(depth + 1);
+          if (lua_isnil(m_L, -1)) corrupt();
+          value(depth + 1);
+          lua_rawset(m_L, -3);
+        }
+        m_pos++; // PACK_END
+        break;
+      }
+      default:
+        corrupt();
+    }
+  }
+private:
+  void corrupt() { luaL_error(m_L, "wxLanesBridge: Corrupt packed data."); }
+  void need(unsigned long long n) { if (n > (unsigned long long)(m_end - m_pos)) corrupt(); }
+  int peek() { need(1); return *m_pos; }
+  int byte() { need(1); return *m_pos++; }
+  void raw(void* v, size_t n) { need(n); memcpy(v, m_pos, n); m_pos += n; }
+  unsigned long long varint() {
+    unsigned long long v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int b = byte();
+      v |= (unsigned long long)(b & 0x7f) << shift;
+      if (!(b & 0x80)) return v;
+    }
+    corrupt();
+    return 0;
+  }
+  lua_State* m_L;
+  const unsigned char* m_pos;
+  const unsigned char* m_end;
+};
+
+// Pushes the value packed into data
+static void unpackValue(lua_State* L, const char* data, size_t size) {
+  Unpacker(L, data, size).value();
+}
+
+// ------------------------------------------------------------------------------
+// Compression of large strings
+
+// Strings at or above a threshold (see bridge.registerChannel) are compressed 
+// in the posting lane and stay compressed while queued. They are decompressed 
+// straight into a Lua string when the GUI thread reads them. The format is the 
+// original size as varint followed by one LZ4 block (literal/match sequences 
+// with 16-bit offsets), so any LZ4 block decoder can read it.
+
+// Threshold argument of readRecord(): ignore the field "compress"
+#define NO_COMPRESSION ((size_t)-1)
+// Bits of the match finder's hash table
+#define COMPRESS_HASH_BITS 12
+// Shortest match, and bytes kept literal at the end of a block (LZ4 rules)
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_LAST_LITERALS 5
+#define COMPRESS_MATCH_LIMIT 12
+
+static unsigned char* putLength(unsigned char* out, size_t len) {
+  if (len < 15) return out;
+  len -= 15;
+  while (len >= 255) {
+    *out++ = 255;
+    len -= 255;
+  }
+  *out++ = (unsigned char)len;
+  return out;
+}
+
+// Emits one sequence (literals from anchor to ip, then a match of matchLen at
+// offset, or no match if matchLen is 0) and returns the new output position
+static unsigned char* putSequence(unsigned char* out, const unsigned char* anchor, 
+                                  const unsigned char* ip, size_t offset, size_t matchLen) {
+  size_t lit = (size_t)(ip - anchor);
+  size_t match = matchLen ? matchLen - COMPRESS_MIN_MATCH : 0;
+  unsigned char* token = out++;
+  *token = (unsigned char)((lit < 15 ? lit : 15) << 4 | (match < 15 ? match : 15));
+  out = putLength(out, lit);
+  memcpy(out, anchor, lit);
+  out += lit;
+  if (!matchLen) return out;
+  *out++ = (unsigned char)offset;
+  *out++ = (unsigned char)(offset >> 8);
+  return putLength(out, match);
+}
+
+// Compresses size bytes at data into out. Returns false, leaving out 
+// unspecified, if this saves less than an eighth of the size.
+static bool compress(const char* data, size_t size, std::string& out) {
+  out.clear();
+  packVarint(out, size);
+  size_t header = out.size();
+  out.resize(header + size + size / 255 + 16); // worst case
+  const unsigned char* src = (const unsigned char*)data;
+  const unsigned char* end = src + size;
+  const unsigned char* anchor = src;
+  const unsigned char* ip = src;
+  unsigned char* op = (unsigned char*)&out[header];
+  if (size > COMPRESS_MATCH_LIMIT) {
+    // Positions + 1 of the last occurrence of each hashed 4-byte sequence 
+    size_t table[1 << COMPRESS_HASH_BITS] = { 0 };
+    const unsigned char* matchLimit = end - COMPRESS_MATCH_LIMIT;
+    const unsigned char* matchEnd = end - COMPRESS_LAST_LITERALS;
+    unsigned misses = 0;
+    while (ip < matchLimit) {
+      uint32_t seq;
+      memcpy(&seq, ip, 4);
+      uint32_t hash = (seq * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+      size_t pos = (size_t)(ip - src);
+      size_t candidate = table[hash];
+      table[hash] = pos + 1;
+      if (!candidate || pos - (candidate - 1) > 0xffff || memcmp(src + candidate - 1, ip, 4) != 0) {
+        // Steps faster through data that does not compress
+        ip += 1 + (misses++ >> 6);
+        continue;
+      }
+      misses = 0;
+      const unsigned char* ref = src + candidate - 1;
+      const unsigned char* m = ip + COMPRESS_MIN_MATCH;
+      const unsigned char* r = ref + COMPRESS_MIN_MATCH;
+      while (m < matchEnd && *m == *r) {
+        m++;
+        r++;
+      }
+      op = putSequence(op, anchor, ip, (size_t)(ip - ref), (size_t)(m - ip));
+      ip = anchor = m;
+    }
+  }
+  op = putSequence(op, anchor, end, 0, 0);
+  out.resize((size_t)(op - (unsigned char*)&out[0]));
+  return out.size() < size - size / 8;
+}
+
+// Decompresses the LZ4 block of size bytes at src into dstSize bytes at dst.
+// Returns false if the block is corrupt.
+static bool decompressBlock(const unsigned char* src, size_t size, unsigned char* dst, size_t dstSize) {
+  const unsigned char* end = src + size;
+  unsigned char* op = dst;
+  unsigned char* opEnd = dst + dstSize;
+  while (src < end) {
+    unsigned token = *src++;
+    size_t lit = token >> 4;
+    if (lit == 15) {
+      unsigned char b;
+      do {
+        if (src == end) return false;
+        b = *src++;
+        lit += b;
+      } while (b == 255);
+    }
+    if (lit > (size_t)(end - src) || lit > (size_t)(opEnd - op)) return false;
+    memcpy(op, src, lit);
+    op += lit;
+    src += lit;
+    if (src == end) break; // the last sequence has no match
+    if (end - src < 2) return false;
+    size_t offset = (size_t)src[0] | (size_t)src[1] << 8;
+    src += 2;
+    if (!offset || offset > (size_t)(op - dst)) return false;
+    size_t match = token & 15;
+    if (match == 15) {
+      unsigned char b;
+      do {
+        if (src == end) return false;
+        b = *src++;
+        match += b;
+      } while (b == 255);
+    }
+    match += COMPRESS_MIN_MATCH;
+    if (match > (size_t)(opEnd - op)) return false;
+    const unsigned char* from = op - offset;
+    if (offset >= match) {
+      memcpy(op, from, match);
+      op += match;
+    }
+    else {
+      // Overlapping match: repeats the last offset bytes
+      while (match--) *op++ = *from++;
+    }
+  }
+  return op == opEnd;
+}
+
+// Pushes the string compressed into size bytes at data (see compress())
+static void pushDecompressed(lua_State* L, const char* data, size_t size) {
+  const unsigned char* pos = (const unsigned char*)data;
+  const unsigned char* end = pos + size;
+  unsigned long long len = 0;
+  for (int shift = 0; ; shift += 7) {
+    if (pos == end || shift >= 64) luaL_error(L, "wxLanesBridge: Corrupt compressed data.");
+    len |= (unsigned long long)(*pos & 0x7f) << shift;
+    if (!(*pos++ & 0x80)) break;
+  }
+  luaL_Buffer b;
+  char* dst = luaL_buffinitsize(L, &b, (size_t)len);
+  if (!decompressBlock(pos, (size_t)(end - pos), (unsigned char*)dst, (size_t)len)) {
+    luaL_error(L, "wxLanesBridge: Corrupt compressed data.");
+  }
+  luaL_pushresultsize(&b, (size_t)len);
+}
+
+// Stores the len bytes at str into out, compressed if len is at least 
+// threshold (0 disables compression) and compression pays off. Returns true
+// if out holds compressed data.
+static bool storeString(const char* str, size_t len, size_t threshold, std::string& out) {
+  if (threshold && len >= threshold && compress(str, len, out)) return true;
+  out.assign(str, len);
+  return false;
+}
+
+// Returns the compression threshold in field "compress" of the table at index
+// idx, or def if the field is nil
+static size_t optThreshold(lua_State* L, int idx, size_t def) {
+  getField(L, idx, UPVALUE_COMPRESS);
+  if (!lua_isnil(L, -1)) {
+    lua_Integer threshold = lua_tointeger(L, -1);
+    if (!lua_isinteger(L, -1) || threshold < 0) {
+      luaL_error(L, "wxLanesBridge: Field 'compress' must be a non-negative integer.");
+    }
+    def = (size_t)threshold;
+  }
+  lua_pop(L, 1);	// pops the threshold or nil
+  return def;
+}
+
+// Pushes a record as table { s=..., i=..., l=... } onto the Lua stack
+static void pushRecord(lua_State* L, const Record& rec) {
+  lua_createtable(L, 0, 3);
+  if (rec.hasS) {
+    if (rec.compressed & COMPRESSED_S) pushDecompressed(L, rec.s.data(), rec.s.size());
+    else lua_pushlstring(L, rec.s.data(), rec.s.size());
+    lua_setfield(L, -2, "s");
+  }
+  lua_pushinteger(L, rec.i);
+  lua_setfield(L, -2, "i");
+  lua_pushinteger(L, rec.l);
+  lua_setfield(L, -2, "l");
+  if (rec.hasB) {
+    if (rec.compressed & COMPRESSED_B) pushDecompressed(L, rec.b.data(), rec.b.size());
+    else lua_pushlstring(L, rec.b.data(), rec.b.size());
+    lua_setfield(L, -2, "b");
+  }
+  if (!rec.k.empty()) {
+    lua_pushlstring(L, rec.k.data(), rec.k.size());
+    lua_setfield(L, -2, "k");
+  }
+  if (rec.buffer.get()) {
+    pushBufferView(L, rec.buffer);
+    lua_setfield(L, -2, "buffer");
+  }
+  if (!rec.value.empty()) {
+    unpackValue(L, rec.value.data(), rec.value.size());
+    lua_setfield(L, -2, "value");
+  }
+}
+
+int BatchPayload::pushRecords(lua_State* L, int n) {
+  for (size_t k = 0; k < records.size(); k++) {
+    pushRecord(L, records[k]);
+    lua_rawseti(L, -2, ++n);
+  }
+  return n;
+}
+
+size_t ValuesPayload::read(lua_State* L, int first, int last) {
+  size_t size = 0;
+  count = 0;
+  for (int idx = first; idx <= last; idx++) {
+    Value& v = values[count++];
+    v.type = lua_type(L, idx);
+    switch (v.type) {
+      case LUA_TBOOLEAN:
+        v.i = lua_toboolean(L, idx);
+        break;
+      case LUA_TNUMBER:
+        v.isInt = lua_isinteger(L, idx) != 0;
+        if (v.isInt) v.i = lua_tointeger(L, idx);
+        else v.d = lua_tonumber(L, idx);
+        break;
+      case LUA_TSTRING: {
+        size_t len;
+        const char* str = lua_tolstring(L, idx, &len);
+        v.s.assign(str, len);
+        size += len;
+        break;
+      }
+      case LUA_TLIGHTUSERDATA:
+        v.p = lua_touserdata(L, idx);
+        break;
+      default:
+        v.type = LUA_TNIL;
+    }
+    if (v.type != LUA_TSTRING) size += sizeof(lua_Integer);
+  }
+  return size;
+}
+
+int ValuesPayload::pushValues(lua_State* L) {
+  luaL_checkstack(L, count, "too many values");
+  for (int k = 0; k < count; k++) {
+    const Value& v = values[k];
+    switch (v.type) {
+      case LUA_TBOOLEAN: lua_pushboolean(L, (int)v.i); break;
+      case LUA_TNUMBER:
+        if (v.isInt) lua_pushinteger(L, v.i);
+        else lua_pushnumber(L, v.d);
+        break;
+      case LUA_TSTRING: lua_pushlstring(L, v.s.data(), v.s.size()); break;
+      case LUA_TLIGHTUSERDATA: lua_pushlightuserdata(L, v.p); break;
+      default: lua_pushnil(L);
+    }
+  }
+  return count;
+}
+
+int ValuesPayload::pushRecords(lua_State* L, int n) {
+  lua_createtable(L, count, 1);
+  int top = lua_gettop(L);
+  pushValues(L);
+  for (int k = count; k >= 1; k--) lua_rawseti(L, top, k);
+  lua_pushinteger(L, count);
+  lua_setfield(L, -2, "n");
+  lua_rawseti(L, -2, ++n);
+  return n;
+}
+
+// Reads the optional fields s, i and l of the table at index idx into rec.
+// Unless threshold is NO_COMPRESSION, s and b are compressed from threshold 
+// bytes up, or as set by the field "compress".
+static void readRecord(lua_State* L, int idx, Record& rec, size_t threshold = NO_COMPRESSION) {
+  if (threshold != NO_COMPRESSION) threshold = optThreshold(L, idx, threshold);
+  else threshold = 0;
+
+  // [s]tring
+  getField(L, idx, UPVALUE_S);
+  if (lua_isstring(L, -1)) {
+    size_t len;
+    const char* str = lua_tolstring(L, -1, &len);
+    if (storeString(str, len, threshold, rec.s)) rec.compressed |= COMPRESSED_S;
+    rec.hasS = true;
+  }
+  lua_pop(L, 1);	// pops the string or nil
+
+  // [i]nteger (intCommand)
+  getField(L, idx, UPVALUE_I);
+  if (lua_isnumber(L, -1)) {
+    rec.i = (int)lua_tointeger(L, -1);
+  }
+  lua_pop(L, 1);	// pops the integer or nil
+
+  // [l]ong (extraLong)
+  getField(L, idx, UPVALUE_L);
+  if (lua_isnumber(L, -1)) {
+    rec.l = (long)lua_tointeger(L, -1);
+  }
+  lua_pop(L, 1);	// pops the extraLong or nil
+
+  // Raw [b]ytes
+  getField(L, idx, UPVALUE_B);
+  if (lua_isstring(L, -1)) {
+    size_t len;
+    const char* str = lua_tolstring(L, -1, &len);
+    if (storeString(str, len, threshold, rec.b)) rec.compressed |= COMPRESSED_B;
+    rec.hasB = true;
+  }
+  lua_pop(L, 1);	// pops the bytes or nil
+
+  // Any Lua [value], packed
+  getField(L, idx, UPVALUE_VALUE);
+  if (!lua_isnil(L, -1)) {
+    rec.value = packScratch(L, -1);
+  }
+  lua_pop(L, 1);	// pops the value or nil
+
+  // Binary buffer (last, so an error in another field takes no buffer reference)
+  readBuffer(L, idx, rec.buffer);
+}
+
+// ------------------------------------------------------------------------------
+// Lock-free ring buffer
+
+// Bounded multi-producer/single-consumer queue of records (D. Vyukov's bounded
+// queue design). Each cell carries a sequence number telling producers and the
+// consumer whether the cell is free or filled. The cells and their strings are
+// allocated once and reused, so pushing short records neither locks nor allocates.
+class Ring : public Payload {
+public:
+  Ring(void* target, size_t capacity, wxEventType eventType);
+  virtual ~Ring() { delete[] m_cells; }
+  // Pointer or handle of the target, resolved via TargetUse for each doorbell
+  void* GetTarget() const { return m_target; }
+  wxEventType GetEventType() const { return m_eventType; }
+  // Producer side (any thread): pushes the data table at index idx and adds
+  // the size of its data to bytes. Returns false if the ring is full.
+  bool push(lua_State* L, int idx, size_t& bytes);
+  // Consumer side (GUI thread): pops all available records into the table on
+  // top of the Lua stack.
+  virtual int pushRecords(lua_State* L, int n);
+  // Doorbell state: true while a doorbell event is under way
+  std::atomic<bool> doorbell;
+private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    Record rec;
+  };
+  void* m_target;
+  wxEventType m_eventType; // of the doorbell events
+  Cell* m_cells;
+  size_t m_mask;
+  char m_pad1[64];
+  std::atomic<size_t> m_enqueuePos;
+  char m_pad2[64];
+  size_t m_dequeuePos; // only touched by the GUI thread
+};
+
+// Payload of a doorbell event. Drains the ring when read by bridge.getBatch().
+// If the handler never drains, the doorbell is re-armed when the event is 
+// deleted, so later pushes ring again.
+class RingDoorbell : public Payload {
+public:
+  RingDoorbell(Ring* ring) : m_ring(ring), m_drained(false) { m_ring->addRef(); }
+  virtual ~RingDoorbell() {
+    if (!m_drained) m_ring->doorbell.store(false);
+    m_ring->release();
+  }
+  virtual int pushRecords(lua_State* L, int n) {
+    // Re-arm before draining: a record pushed after this point rings again.
+    m_drained = true;
+    m_ring->doorbell.store(false);
+    return m_ring->pushRecords(L, n);
+  }
+private:
+  Ring* m_ring;
+  bool m_drained;
+};
+
+Ring::Ring(void* target, size_t capacity, wxEventType eventType)
+  : doorbell(false), m_target(target), m_eventType(eventType), m_enqueuePos(0), m_dequeuePos(0) {
+  // Round capacity up to a power of 2
+  size_t size = 2;
+  while (size < capacity) size <<= 1;
+  m_cells = new Cell[size];
+  for (size_t n = 0; n < size; n++) {
+    m_cells[n].seq.store(n, std::memory_order_relaxed);
+  }
+  m_mask = size - 1;
+}
+
+bool Ring::push(lua_State* L, int idx, size_t& size) {
+  // Fetch all fields first (this may raise Lua errors), leaving them on the
+  // stack so the string pointer stays valid while it is copied into the cell.
+  const char* str = NULL;
+  size_t len = 0;
+  int i = 0;
+  long l = 0;
+  const char* bytes = NULL;
+  size_t bytesLen = 0;
+  Ref<Buffer> buffer;
+  if (lua_istable(L, idx)) {
+    getField(L, idx, UPVALUE_S);
+    if (lua_isstring(L, -1)) str = lua_tolstring(L, -1, &len);
+    getField(L, idx, UPVALUE_I);
+    if (lua_isnumber(L, -1)) i = (int)lua_tointeger(L, -1);
+    getField(L, idx, UPVALUE_L);
+    if (lua_isnumber(L, -1)) l = (long)lua_tointeger(L, -1);
+    getField(L, idx, UPVALUE_B);
+    if (lua_isstring(L, -1)) bytes = lua_tolstring(L, -1, &bytesLen);
+    readBuffer(L, idx, buffer);
+  }
+
+  // Claim a cell
+  Cell* cell;
+  size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+  for (;;) {
+    cell = &m_cells[pos & m_mask];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    }
+    else if (diff < 0) {
+      return false; // full
+    }
+    else {
+      pos = m_enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Fill and publish it. assign() reuses the cell string's capacity.
+  cell->rec.hasS = (str != NULL);
+  cell->rec.s.assign(str ? str : "", len);
+  cell->rec.i = i;
+  cell->rec.l = l;
+  cell->rec.hasB = (bytes != NULL);
+  cell->rec.b.assign(bytes ? bytes : "", bytesLen);
+  cell->rec.buffer.swap(buffer);
+  size += recordBytes(cell->rec);
+  cell->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+int Ring::pushRecords(lua_State* L, int n) {
+  for (;;) {
+    Cell* cell = &m_cells[m_dequeuePos & m_mask];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    if ((intptr_t)seq - (intptr_t)(m_dequeuePos + 1) != 0) break; // empty (or cell still being written)
+    pushRecord(L, cell->rec);
+    lua_rawseti(L, -2, ++n);
+    cell->rec.buffer.reset();
+    cell->seq.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+    m_dequeuePos++;
+  }
+  return n;
+}
+
+// ------------------------------------------------------------------------------
+// Coalescing (last-value-wins) slots
+
+// Pending value of bridge.postLatest() for one (target, key) pair. A slot only
+// exists while its event is under way; a new value for an existing slot simply
+// overwrites the previous one instead of posting another event.
+struct LatestSlot {
+  Record rec;
+  unsigned ticket; // identifies the event belonging to this slot
+};
+typedef std::pair<void*, std::string> LatestKey;
+static std::mutex s_latestMutex;
+static std::map<LatestKey, LatestSlot> s_latestSlots;
+static unsigned s_latestTicket = 0;
+
+// Payload of a postLatest() event. Reading it takes the newest value out of 
+// the slot; deleting the event unread discards the slot, so the next value 
+// posts a new event in either case.
+class LatestPayload : public Payload {
+public:
+  LatestPayload(const LatestKey& key, unsigned ticket) : m_key(key), m_ticket(ticket) {}
+  virtual ~LatestPayload() { take(NULL); }
+  virtual int pushRecords(lua_State* L, int n) {
+    Record rec;
+    if (take(&rec)) {
+      pushRecord(L, rec);
+      lua_rawseti(L, -2, ++n);
+    }
+    return n;
+  }
+private:
+  // Removes the slot if it still belongs to this payload, optionally moving
+  // its record to rec. Returns true if the slot was found.
+  bool take(Record* rec) {
+    std::lock_guard<std::mutex> lock(s_latestMutex);
+    std::map<LatestKey, LatestSlot>::iterator it = s_latestSlots.find(m_key);
+    if (it == s_latestSlots.end() || it->second.ticket != m_ticket) return false;
+    if (rec) std::swap(*rec, it->second.rec);
+    s_latestSlots.erase(it);
+    return true;
+  }
+  LatestKey m_key;
+  unsigned m_ticket;
+};
+
+// ------------------------------------------------------------------------------
+// Paced and bounded delivery
+
+// Overflow policies of targets with a bounded queue (see bridge.configure)
+enum { POLICY_BLOCK, POLICY_DROP_OLDEST, POLICY_DROP_NEWEST, POLICY_FAIL };
+static const char* const s_policyNames[] = { "block", "dropOldest", "dropNewest", "fail", NULL };
+
+// Object with delayed work, scheduled via the pacer
+class Timed : public RefCounted {
+public:
+  // Called by the pacer thread when due
+  virtual void onDue() = 0;
+};
+
+// Per-target state of bridge.configure(). Records posted to a configured target
+// are collected here and delivered with at most one event under way (and at 
+// most one event per interval, if paced). The queue may be bounded.
+class Target : public Timed {
+public:
+  Target(wxWindow* win) 
+    : win(win), interval(Clock::duration::zero()), maxQueue(0), policy(POLICY_BLOCK),
+      timeout(-1), base(0), scheduled(false), paced(false), dead(false), drained(false),
+      budget(Clock::duration::zero()), callback(LUA_NOREF) {}
+  virtual void onDue();
+  wxWindow* const win;
+  std::mutex mutex;
+  std::condition_variable space; // signalled when the GUI thread takes the queue
+  std::deque<Record> queue;
+  std::map<std::string, size_t> latest; // key -> base-relative index in queue for postLatest()
+  Clock::duration interval;
+  size_t maxQueue; // 0 if unbounded
+  int policy;
+  long timeout; // of POLICY_BLOCK in milliseconds, negative for no timeout
+  size_t base; // number of records dropped from the front since the queue was last taken
+  Clock::time_point lastFlush;
+  bool scheduled; // delivery event or pacer timer under way
+  bool paced; // the pacer timer is under way (see bridge.flush)
+  bool dead; // window destroyed (see forgetTarget)
+  bool drained; // records are handed to a callback at idle time (see bridge.drain)
+  // Accessed by the GUI thread only
+  Clock::duration budget; // of the drain callback per idle event
+  int callback; // registry reference of the drain callback
+};
+
+// All configured targets. s_configuredTargets mirrors the size of the map so 
+// the posting functions can skip the lookup while nothing is configured.
+static std::mutex s_targetsMutex;
+static std::map<void*, Target*> s_targets;
+static std::atomic<int> s_configuredTargets(0);
+
+// Main thread of the Lua state of bridge.init(), for callbacks from the bridge
+static lua_State* s_guiState = NULL;
+
+// Host window and event types of native operations and drained targets (see
+// bridge.init)
+static wxWindow* s_host = NULL;
+static wxEventType s_nativeEventID = wxEVT_NULL;
+static wxEventType s_idleEventID = wxEVT_NULL;
+
+// Returns the configured target of win with an added reference, or NULL
+static Target* findTarget(wxWindow* win) {
+  if (s_configuredTargets.load(std::memory_order_relaxed) == 0) return NULL;
+  std::lock_guard<std::mutex> lock(s_targetsMutex);
+  std::map<void*, Target*>::iterator it = s_targets.find(win);
+  if (it == s_targets.end()) return NULL;
+  it->second->addRef();
+  return it->second;
+}
+
+// Payload of a delivery event of a configured target. Hands out everything 
+// collected for the target up to the moment it is read by bridge.getBatch().
+class TargetFlush : public Payload {
+public:
+  TargetFlush(Target* target) : m_target(target), m_drained(false) { m_target->addRef(); }
+  virtual ~TargetFlush() {
+    if (!m_drained) {
+      // Handler did not read the records: discard them
+      std::deque<Record> records;
+      take(records);
+    }
+    m_target->release();
+  }
+  virtual int pushRecords(lua_State* L, int n) {
+    std::deque<Record> records;
+    m_drained = true;
+    take(records);
+    for (size_t k = 0; k < records.size(); k++) {
+      pushRecord(L, records[k]);
+      lua_rawseti(L, -2, ++n);
+    }
+    return n;
+  }
+private:
+  void take(std::deque<Record>& records) {
+    {
+      std::lock_guard<std::mutex> lock(m_target->mutex);
+      records.swap(m_target->queue);
+      m_target->latest.clear();
+      m_target->base = 0;
+      m_target->scheduled = false;
+    }
+    m_target->space.notify_all();
+  }
+  Target* m_target;
+  bool m_drained;
+};
+
+static void postFlush(Target* target) {
+  queueEvent(target->win, new BridgeEvent(s_defaultEventID, new TargetFlush(target)));
+}
+
+// Wakes up the event loop, so the idle handler of the host drains the targets
+// (see bridge.drain)
+static void postWakeUp() {
+  queueEvent(s_host, new BridgeEvent(s_nativeEventID, NULL));
+}
+
+// Timer thread posting delayed deliveries of paced targets and log sinks. 
+// wxTimer is not an option here: if wxWidgets is linked statically, this DLL's
+// wxWidgets instance has no running event loop. The pacer is created on first use and lives until
+// the process ends, as joining a thread while the DLL unloads could deadlock.
+class Pacer {
+public:
+  Pacer() { std::thread(&Pacer::run, this).detach(); }
+  // Calls item->onDue() at time due
+  void schedule(Timed* item, Clock::time_point due) {
+    item->addRef();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_due.insert(std::make_pair(due, item));
+    m_cond.notify_one();
+  }
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+      if (m_due.empty()) {
+        m_cond.wait(lock);
+        continue;
+      }
+      Clock::time_point due = m_due.begin()->first;
+      if (Clock::now() < due) {
+        m_cond.wait_until(lock, due);
+        continue;
+      }
+      Timed* item = m_due.begin()->second;
+      m_due.erase(m_due.begin());
+      lock.unlock();
+      item->onDue();
+      item->release();
+      lock.lock();
+    }
+  }
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::multimap<Clock::time_point, Timed*> m_due;
+};
+static Pacer* s_pacer = NULL;
+
+// Results of deliver()
+enum { DELIVER_ADDED, DELIVER_REPLACED, DELIVER_DROPPED, DELIVER_REJECTED };
+
+// Queues rec for a configured target. If key is given, a queued record with
+// the same key is replaced. A full queue is handled according to the target's
+// policy. Schedules the delivery event if none is under way.
+static int deliver(Target* target, Record& rec, const std::string* key) {
+  int result = DELIVER_ADDED;
+  Clock::time_point due;
+  Clock::time_point now;
+  {
+    std::unique_lock<std::mutex> lock(target->mutex);
+    if (target->dead) return DELIVER_REJECTED;
+    if (key) {
+      std::map<std::string, size_t>::iterator it = target->latest.find(*key);
+      if (it != target->latest.end()) {
+        // Replacing does not need more space, and the event is under way
+        std::swap(target->queue[it->second - target->base], rec);
+        return DELIVER_REPLACED;
+      }
+    }
+    if (target->maxQueue && target->queue.size() >= target->maxQueue) {
+      switch (target->policy) {
+        case POLICY_BLOCK: {
+          // Wait for the GUI thread to take the queue (but never block the GUI thread itself)
+          auto room = [target] {
+            return target->dead || s_closed.load() || !target->maxQueue || 
+              target->queue.size() < target->maxQueue;
+          };
+          if (std::this_thread::get_id() != s_guiThread) {
+            if (target->timeout < 0) {
+              target->space.wait(lock, room);
+            }
+            else {
+              target->space.wait_for(lock, std::chrono::milliseconds(target->timeout), room);
+            }
+          }
+          if (target->dead || s_closed.load()) return DELIVER_REJECTED;
+          if (!room()) {
+            stats().drop(target->win);
+            return DELIVER_REJECTED;
+          }
+          // Another lane may have queued the same key meanwhile
+          std::map<std::string, size_t>::iterator it;
+          if (key && (it = target->latest.find(*key)) != target->latest.end()) {
+            std::swap(target->queue[it->second - target->base], rec);
+            return DELIVER_REPLACED;
+          }
+          break;
+        }
+        case POLICY_DROP_OLDEST: {
+          Record& oldest = target->queue.front();
+          if (!oldest.k.empty()) target->latest.erase(oldest.k);
+          target->queue.pop_front();
+          target->base++;
+          stats().drop(target->win);
+          break;
+        }
+        case POLICY_DROP_NEWEST:
+          stats().drop(target->win);
+          return DELIVER_DROPPED;
+        default:
+          stats().drop(target->win);
+          return DELIVER_REJECTED;
+      }
+    }
+    if (key) target->latest[*key] = target->base + target->queue.size();
+    target->queue.push_back(Record());
+    std::swap(target->queue.back(), rec);
+    if (target->scheduled) return result;
+    target->scheduled = true;
+    if (target->drained) {
+      // Pacing does not apply: the idle handler takes what it has time for
+      lock.unlock();
+      postWakeUp();
+      return result;
+    }
+    now = Clock::now();
+    due = target->lastFlush + target->interval;
+    if (due <= now) target->lastFlush = now;
+    else target->paced = true;
+  }
+  if (due <= now) {
+    postFlush(target);
+  }
+  else {
+    s_pacer->schedule(target, due);
+  }
+  return result;
+}
+
+// Unconfigures the target of a destroyed window. Lanes blocked on its queue 
+// give up, and the pacer no longer posts to it.
+static void forgetTarget(wxWindow* win) {
+  Target* target = NULL;
+  {
+    std::lock_guard<std::mutex> lock(s_targetsMutex);
+    std::map<void*, Target*>::iterator it = s_targets.find(win);
+    if (it == s_targets.end()) return;
+    target = it->second;
+    s_targets.erase(it);
+    s_configuredTargets--;
+  }
+  {
+    std::lock_guard<std::mutex> targetLock(target->mutex);
+    target->dead = true;
+  }
+  target->space.notify_all();
+  target->release();
+}
+
+// ------------------------------------------------------------------------------
+// Priority delivery
+// ------------------------------------------------------------------------------
+
+// Urgent records of one target. They are handed out ahead of everything else 
+// by the next bridge.getBatch() call for the target, whichever bridge event it
+// is called for, so they overtake the bulk events already queued in wxWidgets.
+struct UrgentQueue {
+  UrgentQueue() : ticket(0), scheduled(false) {}
+  std::deque<Record> records;
+  unsigned ticket; // of the latest priority event
+  bool scheduled; // priority event under way
+};
+
+static std::mutex s_urgentMutex;
+static std::map<void*, UrgentQueue> s_urgent;
+static std::atomic<size_t> s_urgentPending(0); // records in all urgent queues
+static unsigned s_urgentTicket = 0;
+
+// Event type of priority events (see bridge.init), wxEVT_NULL for the default
+static wxEventType s_priorityEventID = wxEVT_NULL;
+
+// Pushes the urgent records of win, flagged urgent = true, into the table on 
+// top of the Lua stack. The entry of win is removed, so no entry outlives its
+// records: a target given as raw pointer has no destroy hook, and a new window
+// at the same address must not inherit it.
+static int pushUrgent(lua_State* L, void* win, int n) {
+  if (s_urgentPending.load(std::memory_order_acquire) == 0) return n;
+  std::deque<Record> records;
+  {
+    std::lock_guard<std::mutex> lock(s_urgentMutex);
+    std::map<void*, UrgentQueue>::iterator it = s_urgent.find(win);
+    if (it == s_urgent.end()) return n;
+    records.swap(it->second.records);
+    s_urgentPending.fetch_sub(records.size());
+    s_urgent.erase(it); // a priority event still under way finds no entry
+  }
+  for (size_t k = 0; k < records.size(); k++) {
+    pushRecord(L, records[k]);
+    lua_pushboolean(L, 1);
+    lua_setfield(L, -2, "urgent");
+    lua_rawseti(L, -2, ++n);
+  }
+  return n;
+}
+
+// Payload of a priority event
+class UrgentPayload : public Payload {
+public:
+  UrgentPayload(void* win, unsigned ticket) : m_win(win), m_ticket(ticket) {}
+  virtual ~UrgentPayload() {
+    // Discard the records if nobody read them and no newer event is under way 
+    std::lock_guard<std::mutex> lock(s_urgentMutex);
+    std::map<void*, UrgentQueue>::iterator it = s_urgent.find(m_win);
+    if (it == s_urgent.end() || it->second.ticket != m_ticket) return;
+    s_urgentPending.fetch_sub(it->second.records.size());
+    s_urgent.erase(it);
+  }
+  virtual int pushRecords(lua_State* L, int n) { return pushUrgent(L, m_win, n); }
+private:
+  void* m_win;
+  unsigned m_ticket;
+};
+
+// Discards the urgent records of a destroyed window
+static void forgetUrgent(wxWindow* win) {
+  std::lock_guard<std::mutex> lock(s_urgentMutex);
+  std::map<void*, UrgentQueue>::iterator it = s_urgent.find(win);
+  if (it == s_urgent.end()) return;
+  s_urgentPending.fetch_sub(it->second.records.size());
+  s_urgent.erase(it);
+}
+
+// ------------------------------------------------------------------------------
+// Mailboxes (GUI thread to lanes)
+// ------------------------------------------------------------------------------
+
+// Queue of records sent to one or more lanes. count mirrors the queue size, so
+// a lane can check for commands in its inner loop without taking a lock.
+class Mailbox : public RefCounted {
+public:
+  Mailbox() : count(0), closed(false) {}
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<Record> queue;
+  std::atomic<size_t> count;
+  bool closed;
+};
+
+// ------------------------------------------------------------------------------
+// Handle registry
+// ------------------------------------------------------------------------------
+
+// Handles returned by bridge.handle() are lightuserdata values with the lowest
+// bit set, which no (aligned) object address has. The other bits hold a slot 
+// index and the generation of the slot when the handle was issued. Destroying 
+// the window advances the generation, so all its handles are dead from then on.
+#define HANDLE_INDEX_BITS 12
+#define MAX_HANDLES (1 << HANDLE_INDEX_BITS)
+#define HANDLE_GEN_MASK (UINTPTR_MAX >> (HANDLE_INDEX_BITS + 1))
+
+struct HandleSlot {
+  HandleSlot() : gen(0), users(0), win(NULL) {}
+  std::atomic<uintptr_t> gen; // odd while the slot is live
+  std::atomic<int> users; // posting functions currently using win
+  wxWindow* win;
+};
+
+// Registry of handles. Slots are only allocated in the GUI thread, lookups are 
+// lock-free. Never destroyed: lanes may still hold handles when the DLL unloads.
+class HandleRegistry {
+public:
+  HandleRegistry() : m_used(0) {}
+  // Returns the live handle of win, issuing a new one if there is none.
+  // Returns NULL if all slots are in use.
+  void* issue(wxWindow* win) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<wxWindow*, size_t>::iterator it = m_index.find(win);
+    if (it != m_index.end()) return encode(it->second, m_slots[it->second].gen.load());
+    size_t idx;
+    if (!m_free.empty()) {
+      idx = m_free.back();
+      m_free.pop_back();
+    }
+    else if (m_used < MAX_HANDLES) {
+      idx = m_used++;
+    }
+    else {
+      return NULL;
+    }
+    HandleSlot& slot = m_slots[idx];
+    slot.win = win;
+    uintptr_t gen = slot.gen.load() + 1;
+    slot.gen.store(gen); // publishes win
+    m_index[win] = idx;
+    return encode(idx, gen);
+  }
+  // Kills the handles of win, if any, and waits until no lane uses win anymore
+  void invalidate(wxWindow* win) {
+    size_t idx;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      std::map<wxWindow*, size_t>::iterator it = m_index.find(win);
+      if (it == m_index.end()) return;
+      idx = it->second;
+      m_index.erase(it);
+    }
+    HandleSlot& slot = m_slots[idx];
+    slot.gen.fetch_add(1);
+    forgetTarget(win);
+    forgetUrgent(win);
+    // Posting functions hold the slot for microseconds only
+    while (slot.users.load() != 0) std::this_thread::yield();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(idx);
+  }
+  // Returns the live handle of win, or NULL if there is none
+  void* find(wxWindow* win) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<wxWindow*, size_t>::iterator it = m_index.find(win);
+    if (it == m_index.end()) return NULL;
+    return encode(it->second, m_slots[it->second].gen.load());
+  }
+  static bool isHandle(void* ptr) { return ((uintptr_t)ptr & 1) != 0; }
+  // Returns the slot of a handle and its generation in gen
+  HandleSlot* slot(void* handle, uintptr_t& gen) {
+    uintptr_t value = (uintptr_t)handle >> 1;
+    gen = value >> HANDLE_INDEX_BITS;
+    return &m_slots[value & (MAX_HANDLES - 1)];
+  }
+  // Returns the window of a live handle, NULL if the handle is dead
+  wxWindow* resolve(void* handle) {
+    if (!handle) return NULL;
+    uintptr_t gen;
+    HandleSlot* s = slot(handle, gen);
+    return s && live(s, gen) ? s->win : NULL;
+  }
+  static bool live(HandleSlot* slot, uintptr_t gen) {
+    return (slot->gen.load() & HANDLE_GEN_MASK) == gen;
+  }
+private:
+  static void* encode(size_t idx, uintptr_t gen) {
+    // Generations are truncated to the bits available in a pointer
+    return (void*)(((((gen & HANDLE_GEN_MASK) << HANDLE_INDEX_BITS) | idx) << 1) | 1);
+  }
+  std::mutex m_mutex;
+  HandleSlot m_slots[MAX_HANDLES];
+  std::map<wxWindow*, size_t> m_index;
+  std::vector<size_t> m_free;
+  size_t m_used;
+};
+
+static HandleRegistry& handles() {
+  static HandleRegistry* s_handles = new HandleRegistry();
+  return *s_handles;
+}
+
+// Event type of wxEVT_DESTROY in wxLua's wxWidgets instance (see bridge.init)
+static wxEventType s_destroyEventID = wxEVT_NULL;
+
+// Destroy hook bound to every window with a handle
+static void onWindowDestroy(wxWindowDestroyEvent& event) {
+  event.Skip();
+  wxWindow* win = event.GetWindow();
+  if (win) handles().invalidate(win);
+}
+
+// Set in the GUI thread while bridge.flush() delivers what is pending
+static thread_local bool t_flushing = false;
+
+// Counts a post under way while it exists. bridge.flush() and 
+// bridge.shutdown() set s_closed and then wait until no post is under way, so
+// no lane queues an event after they return.
+class PostGuard {
+public:
+  PostGuard() {
+    s_posting.fetch_add(1);
+    m_ok = !s_closed.load() || t_flushing;
+  }
+  ~PostGuard() { s_posting.fetch_sub(1); }
+  // False once posts are closed, except for the deliveries of bridge.flush()
+  bool ok() const { return m_ok; }
+private:
+  PostGuard(const PostGuard&);
+  PostGuard& operator=(const PostGuard&);
+  bool m_ok;
+};
+
+// Posts the delayed delivery event of a paced target
+void Target::onDue() {
+  PostGuard guard;
+  // Posting under the target lock: forgetTarget() cannot pass meanwhile
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!paced) return; // delivered by bridge.flush()
+  paced = false;
+  lastFlush = Clock::now();
+  if (!guard.ok()) {
+    // Posts closed: bridge.flush() or bridge.shutdown() took over
+    scheduled = false;
+    return;
+  }
+  if (!dead) {
+    if (drained) postWakeUp();
+    else postFlush(this);
+  }
+}
+
+// Holds the window behind a target pointer or handle (argument idx of a 
+// posting function) while events are queued for it. For a handle, the 
+// destruction of the window waits until the holder is gone. No Lua error may be
+// raised while the holder exists, as it would skip the destructor.
+class TargetUse {
+public:
+  TargetUse(lua_State* L, int idx) : m_slot(NULL), m_win(NULL) { acquire(lua_touserdata(L, idx)); }
+  explicit TargetUse(void* ptr) : m_slot(NULL), m_win(NULL) { acquire(ptr); }
+  ~TargetUse() { if (m_slot) m_slot->users.fetch_sub(1); }
+  wxWindow* get() const { return m_win; }
+private:
+  TargetUse(const TargetUse&);
+  TargetUse& operator=(const TargetUse&);
+  void acquire(void* ptr) {
+    if (!m_guard.ok()) return; // posts closed
+    if (!HandleRegistry::isHandle(ptr)) {
+      m_win = (wxWindow*)ptr;
+      return;
+    }
+    uintptr_t gen;
+    HandleSlot* slot = handles().slot(ptr, gen);
+    if (!slot) return;
+    slot->users.fetch_add(1);
+    if (!HandleRegistry::live(slot, gen)) {
+      slot->users.fetch_sub(1);
+      return;
+    }
+    m_slot = slot;
+    m_win = slot->win;
+  }
+  PostGuard m_guard;
+  HandleSlot* m_slot;
+  wxWindow* m_win;
+};
+
+// ------------------------------------------------------------------------------
+// Native widget operations
+// ------------------------------------------------------------------------------
+
+// Simple widget updates (gauge value, label, status text) requested by lanes
+// are applied by C++ code in the GUI thread, without entering Lua. CallAfter()
+// cannot be used for this: if wxWidgets is linked statically, the
+// wxEVT_ASYNC_METHOD_CALL of this DLL's instance is unknown to wxLua's. 
+// Instead, a handler is bound to a host window for an event type of wxLua's
+// instance (see bridge.init). Pending operations are coalesced per widget and 
+// operation, so only the newest value is applied.
+enum { NATIVE_GAUGE_VALUE, NATIVE_LABEL, NATIVE_STATUS_TEXT };
+
+struct NativeKey {
+  NativeKey(void* target, int op, int field) : target(target), op(op), field(field) {}
+  bool operator<(const NativeKey& other) const {
+    if (target != other.target) return target < other.target;
+    if (op != other.op) return op < other.op;
+    return field < other.field;
+  }
+  void* target; // pointer or handle
+  int op;
+  int field; // of the status bar
+};
+
+struct NativeOp {
+  NativeOp() : value(0) {}
+  int value;
+  std::string text;
+};
+
+// Returns true if info is the class info of className or of a class derived 
+// from it. Compares names instead of wxClassInfo pointers (as IsKindOf() does):
+// with wxWidgets linked statically, wxLua's windows carry the class infos of
+// wxLua's wxWidgets instance, which are distinct from those of this DLL.
+static bool isKindOf(const wxClassInfo* info, const wxChar* className) {
+  if (!info) return false;
+  if (wxStrcmp(info->GetClassName(), className) == 0) return true;
+  return isKindOf(info->GetBaseClass1(), className) || isKindOf(info->GetBaseClass2(), className);
+}
+
+static std::mutex s_nativeMutex;
+static std::map<NativeKey, NativeOp> s_nativeOps;
+static bool s_nativeScheduled = false; // host event under way
+
+// Applies all pending native operations (GUI thread). Operations for a window
+// of the wrong class are skipped and counted as dropped.
+static void applyNativeOps() {
+  std::map<NativeKey, NativeOp> ops;
+  {
+    std::lock_guard<std::mutex> lock(s_nativeMutex);
+    ops.swap(s_nativeOps);
+    s_nativeScheduled = false;
+  }
+  for (std::map<NativeKey, NativeOp>::iterator it = ops.begin(); it != ops.end(); ++it) {
+    TargetUse use(it->first.target);
+    wxWindow* win = use.get();
+    if (!win) continue; // handle died meanwhile
+    const NativeOp& op = it->second;
+    const wxClassInfo* info = win->GetClassInfo();
+    switch (it->first.op) {
+      case NATIVE_GAUGE_VALUE:
+        if (!isKindOf(info, wxT("wxGauge"))) break;
+        static_cast<wxGauge*>(win)->SetValue(op.value);
+        continue;
+      case NATIVE_LABEL:
+        if (!isKindOf(info, wxT("wxWindow"))) break;
+        win->SetLabel(toWxString(op.text.data(), op.text.size()));
+        continue;
+      case NATIVE_STATUS_TEXT:
+        if (!isKindOf(info, wxT("wxFrame"))) break;
+        static_cast<wxFrame*>(win)->SetStatusText(toWxString(op.text.data(), op.text.size()), it->first.field);
+        continue;
+    }
+    stats().drop(win);
+  }
+}
+
+// Payload of host events doing other work than native operations
+class HostTask : public Payload {
+public:
+  // Called in the GUI thread when the host handles the event
+  virtual void run() = 0;
+  virtual int pushRecords(lua_State*, int n) { return n; }
+};
+
+// Handler of the host events (GUI thread). Events without payload carry native
+// operations, or merely wake up the event loop for drained targets.
+static void onHostEvent(wxThreadEvent& event) {
+  // Only BridgeEvents are posted with the host's event type
+  Payload* payload = static_cast<BridgeEvent&>(event).GetPayload();
+  if (payload) static_cast<HostTask*>(payload)->run();
+  else applyNativeOps();
+}
+
+// Stores op for the target and schedules the host event if none is under way
+static void postNative(const NativeKey& key, NativeOp& op) {
+  PostGuard guard;
+  if (!guard.ok()) return; // posts closed
+  bool schedule;
+  {
+    std::lock_guard<std::mutex> lock(s_nativeMutex);
+    std::swap(s_nativeOps[key], op);
+    schedule = !s_nativeScheduled;
+    s_nativeScheduled = true;
+  }
+  if (schedule) queueEvent(s_host, new BridgeEvent(s_nativeEventID, NULL));
+}
+
+// ------------------------------------------------------------------------------
+// Drained delivery
+// ------------------------------------------------------------------------------
+
+// Records of drained targets are handed to their Lua callbacks one by one by
+// the idle handler of the host window, until the time budget of the target is 
+// used up. The handler then requests another idle event and returns, so the
+// event loop processes user input before draining continues.
+static std::vector<Target*> s_drained; // with a reference each; GUI thread only
+
+// Calls the callback at index 1 with the record (lightuserdata) at index 2
+static int drainCall(lua_State* L) {
+  pushRecord(L, *(Record*)lua_touserdata(L, 2));
+  lua_replace(L, 2);
+  lua_call(L, 1, 0);
+  return 0;
+}
+
+// Hands the queued records of target to its callback, counting them in count.
+// Returns true if records are left when the budget is used up.
+static bool drainTarget(Target* target, size_t& count) {
+  lua_State* L = s_guiState;
+  Clock::time_point deadline = Clock::now() + target->budget;
+  for (;;) {
+    Record rec;
+    {
+      std::lock_guard<std::mutex> lock(target->mutex);
+      if (!target->drained || target->dead) return false; // ended by the callback
+      if (target->queue.empty()) {
+        target->scheduled = false;
+        return false;
+      }
+      std::swap(rec, target->queue.front());
+      if (!rec.k.empty()) target->latest.erase(rec.k);
+      target->queue.pop_front();
+      target->base++;
+    }
+    target->space.notify_all();
+    count++;
+    int top = lua_gettop(L);
+    lua_pushcfunction(L, drainCall);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, target->callback);
+    lua_pushlightuserdata(L, &rec);
+    if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+      // Raising the error here would unwind through wxWidgets
+      const char* msg = lua_tostring(L, -1);
+      lua_writestringerror("wxLanesBridge: Error in drain callback: %s\n", msg ? msg : "(no message)");
+    }
+    lua_settop(L, top);
+    if (Clock::now() >= deadline) {
+      std::lock_guard<std::mutex> lock(target->mutex);
+      if (target->queue.empty()) {
+        target->scheduled = false;
+        return false;
+      }
+      return true;
+    }
+  }
+}
+
+// Ends draining of target. Returns its callback reference, to be released.
+static int undrain(Target* target) {
+  for (size_t n = 0; n < s_drained.size(); n++) {
+    if (s_drained[n] == target) {
+      s_drained.erase(s_drained.begin() + n);
+      break;
+    }
+  }
+  int callback = target->callback;
+  target->callback = LUA_NOREF;
+  bool flush;
+  {
+    std::lock_guard<std::mutex> lock(target->mutex);
+    target->drained = false;
+    // Records left are delivered as a batch (see bridge.getBatch)
+    flush = !target->dead && !target->queue.empty();
+    target->scheduled = flush;
+    if (flush) postFlush(target);
+  }
+  target->release();
+  return callback;
+}
+
+static void onDrainIdle(wxIdleEvent& event) {
+  event.Skip(); // other idle handlers of the host still run
+  for (size_t n = 0; n < s_drained.size(); ) {
+    Target* target = s_drained[n];
+    bool dead;
+    {
+      std::lock_guard<std::mutex> lock(target->mutex);
+      dead = target->dead;
+    }
+    if (dead) {
+      // Window destroyed: release the callback (see forgetTarget)
+      luaL_unref(s_guiState, LUA_REGISTRYINDEX, undrain(target));
+      continue;
+    }
+    // The callback may end draining and thus release the target
+    target->addRef();
+    Clock::time_point start;
+    if (TRACING()) start = Clock::now();
+    size_t count = 0;
+    if (drainTarget(target, count)) event.RequestMore();
+    if (count) traceSpan(TRACE_DRAIN, target->win, count, start);
+    if (n < s_drained.size() && s_drained[n] == target) n++;
+    target->release();
+  }
+}
+
+// ------------------------------------------------------------------------------
+// Log sinks
+// ------------------------------------------------------------------------------
+
+// All log sinks, for bridge.flush() and bridge.shutdown()
+class LogSink;
+static std::mutex s_sinksMutex;
+static std::vector<LogSink*> s_sinks;
+
+// Text collected by lanes for a wxTextCtrl (see bridge.logSink). All lines
+// written until the GUI thread gets to the flush event are appended with a
+// single AppendText(). Flushes are paced by the interval, unless the pending 
+// text reaches the threshold.
+class LogSink : public Timed {
+public:
+  LogSink(void* target, size_t maxLines, Clock::duration interval, size_t threshold)
+    : target(target), maxLines(maxLines), interval(interval), threshold(threshold),
+      m_lines(0), m_flushPosted(false), m_timerPending(false) {
+    std::lock_guard<std::mutex> lock(s_sinksMutex);
+    s_sinks.push_back(this);
+  }
+  virtual ~LogSink() {
+    std::lock_guard<std::mutex> lock(s_sinksMutex);
+    s_sinks.erase(std::find(s_sinks.begin(), s_sinks.end(), this));
+  }
+  // Appends a line of text (any thread)
+  void write(const char* text, size_t len);
+  // Appends the pending text to the control (GUI thread)
+  void flush();
+  // Drops the pending text. Returns the number of lines dropped.
+  size_t discard();
+  virtual void onDue();
+  void* const target; // pointer or handle of the wxTextCtrl
+  const size_t maxLines; // 0 if unlimited
+  const Clock::duration interval;
+  const size_t threshold; // in bytes, 0 if none
+private:
+  void postFlush();
+  std::mutex m_mutex;
+  std::string m_pending;
+  size_t m_lines; // in m_pending
+  Clock::time_point m_lastFlush;
+  bool m_flushPosted; // flush event under way
+  bool m_timerPending; // pacer scheduled
+};
+
+// Payload of a host event flushing a log sink
+class LogFlush : public HostTask {
+public:
+  LogFlush(LogSink* sink) : m_sink(sink) { m_sink->addRef(); }
+  virtual ~LogFlush() { m_sink->release(); }
+  virtual void run() { m_sink->flush(); }
+private:
+  LogSink* m_sink;
+};
+
+// Called with m_mutex held
+void LogSink::postFlush() {
+  PostGuard guard;
+  if (!guard.ok()) return; // posts closed
+  m_flushPosted = true;
+  queueEvent(s_host, new BridgeEvent(s_nativeEventID, new LogFlush(this)));
+}
+
+void LogSink::write(const char* text, size_t len) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_pending.append(text, len);
+  m_pending += '\n';
+  m_lines += std::count(text, text + len, '\n') + 1;
+  if (maxLines && m_lines > 2 * maxLines) {
+    // GUI thread lagging behind: drop the lines that would be cut off anyway
+    size_t pos = 0;
+    for (size_t n = m_lines - maxLines; n > 0; n--) pos = m_pending.find('\n', pos) + 1;
+    m_pending.erase(0, pos);
+    m_lines = maxLines;
+  }
+  if (m_flushPosted) return;
+  Clock::time_point due = m_lastFlush + interval;
+  if (due <= Clock::now() || (threshold && m_pending.size() >= threshold)) {
+    postFlush();
+  }
+  else if (!m_timerPending) {
+    m_timerPending = true;
+    s_pacer->schedule(this, due);
+  }
+}
+
+void LogSink::onDue() {
+  PostGuard guard;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_timerPending = false;
+  // Once posts are closed, bridge.flush() writes the text itself
+  if (guard.ok() && !m_flushPosted && !m_pending.empty()) postFlush();
+}
+
+size_t LogSink::discard() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t lines = m_lines;
+  m_pending.clear();
+  m_lines = 0;
+  return lines;
+}
+
+void LogSink::flush() {
+  std::string text;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    text.swap(m_pending);
+    m_lines = 0;
+    m_flushPosted = false;
+    m_lastFlush = Clock::now();
+  }
+  if (text.empty()) return;
+  TargetUse use(target);
+  wxWindow* win = use.get();
+  if (!win) return; // handle died meanwhile
+  if (!isKindOf(win->GetClassInfo(), wxT("wxTextCtrl"))) return; // see applyNativeOps()
+  wxTextCtrl* ctrl = static_cast<wxTextCtrl*>(win);
+  ctrl->AppendText(toWxString(text.data(), text.size()));
+  if (maxLines) {
+    // The text ends with a newline, so the last line of the control is empty
+    long excess = (long)ctrl->GetNumberOfLines() - 1 - (long)maxLines;
+    if (excess > 0) ctrl->Remove(0, ctrl->XYToPosition(0, excess));
+  }
+}
+
+// ------------------------------------------------------------------------------
+// Shared arrays
+// ------------------------------------------------------------------------------
+
+// Element types of bridge.sharedArray()
+enum { ARRAY_DOUBLE, ARRAY_FLOAT, ARRAY_INT32 };
+static const char* const s_arrayTypeNames[] = { "double", "float", "int32", NULL };
+static const size_t s_arrayTypeSizes[] = { sizeof(double), sizeof(float), sizeof(int32_t) };
+
+// Numeric array shared by one writing lane and the GUI thread without copying,
+// as a triple buffer: the writer fills the back buffer and swaps it with the
+// middle one when publishing; the GUI thread swaps the middle buffer with the
+// front one if it holds newer data. Neither side locks or waits for the other.
+class SharedArray : public RefCounted {
+public:
+  SharedArray(size_t size, int type, void* target, wxEventType eventType)
+    : doorbell(false), m_size(size), m_type(type), m_target(target), m_eventType(eventType),
+      m_state(1), m_back(0), m_front(2), m_published(0) {
+    size_t bytes = 3 * size * s_arrayTypeSizes[type];
+    m_data = new double[(bytes + sizeof(double) - 1) / sizeof(double)](); // zeroed
+    for (int n = 0; n < 3; n++) m_seq[n] = 0;
+  }
+  virtual ~SharedArray() { delete[] m_data; }
+  size_t size() const { return m_size; }
+  int type() const { return m_type; }
+  void* target() const { return m_target; }
+  wxEventType GetEventType() const { return m_eventType; }
+  // Writer side
+  void* back() { return buffer(m_back); }
+  // Publishes the back buffer, returns its sequence number
+  unsigned long long publish() {
+    unsigned long long seq = ++m_published;
+    m_seq[m_back] = seq;
+    m_back = m_state.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+    return seq;
+  }
+  // GUI thread: takes the newest published buffer, if any, and returns the 
+  // front buffer and its sequence number (0 if nothing was published yet)
+  void* take(unsigned long long& seq) {
+    doorbell.store(false); // publishing from now on rings again
+    if (m_state.load(std::memory_order_acquire) & FRESH) {
+      m_front = m_state.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+    }
+    seq = m_seq[m_front];
+    return buffer(m_front);
+  }
+  // GUI thread: the front buffer taken last
+  void* front() { return buffer(m_front); }
+  std::atomic<bool> doorbell; // true while a doorbell event is under way
+private:
+  enum { INDEX = 3, FRESH = 4 };
+  void* buffer(unsigned idx) { return (char*)m_data + idx * m_size * s_arrayTypeSizes[m_type]; }
+  const size_t m_size;
+  const int m_type;
+  void* const m_target; // pointer or handle, NULL if publishing does not ring
+  const wxEventType m_eventType;
+  double* m_data;
+  std::atomic<unsigned> m_state; // index of the middle buffer | FRESH
+  unsigned m_back; // writer only
+  unsigned m_front; // GUI thread only
+  unsigned long long m_published; // writer only
+  unsigned long long m_seq[3]; // sequence number of each buffer's contents
+};
+
+// Payload of a doorbell event of a shared array. The doorbell is re-armed when
+// the event is deleted, in case the handler did not read the array.
+class ArrayDoorbell : public Payload {
+public:
+  ArrayDoorbell(SharedArray* array) : m_array(array) { m_array->addRef(); }
+  virtual ~ArrayDoorbell() {
+    m_array->doorbell.store(false);
+    m_array->release();
+  }
+  virtual int pushRecords(lua_State*, int n) { return n; }
+private:
+  SharedArray* m_array;
+};
+
+// ------------------------------------------------------------------------------
+// Worker pool
+// ------------------------------------------------------------------------------
+
+// Job of a worker pool: a function, as bytecode or source, with its packed 
+// arguments. The results are posted to the target.
+struct Job {
+  Job() : target(NULL), eventType(wxEVT_NULL), id(0) {}
+  std::string code;
+  std::string args; // packed table of the arguments, with field n
+  void* target; // pointer or handle, NULL if the results are discarded
+  wxEventType eventType;
+  lua_Integer id;
+};
+
+// Runs the job (lightuserdata at index 1) in a worker's Lua state and packs 
+// its results, as a table with field n, into the string at index 2
+static int runJob(lua_State* L) {
+  Job* job = (Job*)lua_touserdata(L, 1);
+  std::string* out = (std::string*)lua_touserdata(L, 2);
+  if (luaL_loadbuffer(L, job->code.data(), job->code.size(), "=job") != LUA_OK) lua_error(L);
+  int fn = lua_gettop(L);
+  unpackValue(L, job->args.data(), job->args.size());
+  lua_getfield(L, -1, "n");
+  int nargs = (int)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  luaL_checkstack(L, nargs, "too many arguments");
+  for (int n = 1; n <= nargs; n++) lua_rawgeti(L, fn + 1, n);
+  lua_remove(L, fn + 1);
+  lua_call(L, nargs, LUA_MULTRET);
+  int nresults = lua_gettop(L) - fn + 1;
+  lua_createtable(L, nresults, 1);
+  for (int n = 1; n <= nresults; n++) {
+    lua_pushvalue(L, fn + n - 1);
+    lua_rawseti(L, -2, n);
+  }
+  lua_pushinteger(L, nresults);
+  lua_setfield(L, -2, "n");
+  packValue(L, lua_gettop(L), *out);
+  return 0;
+}
+
+// Fixed set of threads, each with its own Lua state created and prepared once.
+// Every worker has its own job queue: jobs are submitted round-robin, workers 
+// take their own newest job first and steal the oldest jobs of others when 
+// their queue is empty. Each worker thread holds a reference to the pool.
+class WorkerPool : public RefCounted {
+public:
+  WorkerPool(size_t count, const std::string& init)
+    : m_workers(new Worker[count]), m_count(count), m_init(init),
+      m_queued(0), m_next(0), m_lastId(0), m_closed(false) {
+    for (size_t n = 0; n < count; n++) {
+      addRef();
+      std::thread(&WorkerPool::run, this, n).detach();
+    }
+  }
+  virtual ~WorkerPool() { delete[] m_workers; }
+  lua_Integer nextId() { return ++m_lastId; }
+  // Queues job (taking over its contents)
+  void submit(Job& job) {
+    Worker& worker = m_workers[m_next++ % m_count];
+    // Counted before the job can be taken, so take() never wraps m_queued
+    m_queued++;
+    {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      worker.jobs.push_back(Job());
+      std::swap(worker.jobs.back(), job);
+    }
+    {
+      // Pairs with the check of m_queued in run()
+      std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_wake.notify_one();
+  }
+  // Lets the workers finish the queued jobs and end
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closed = true;
+    }
+    m_wake.notify_all();
+  }
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+  bool take(size_t idx, Job& job) {
+    for (size_t k = 0; k < m_count; k++) {
+      Worker& worker = m_workers[(idx + k) % m_count];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (worker.jobs.empty()) continue;
+      if (k == 0) {
+        std::swap(job, worker.jobs.back());
+        worker.jobs.pop_back();
+      }
+      else {
+        std::swap(job, worker.jobs.front());
+        worker.jobs.pop_front();
+      }
+      m_queued--;
+      return true;
+    }
+    return false;
+  }
+  void execute(lua_State* L, Job& job) {
+    std::string results;
+    lua_pushcfunction(L, runJob);
+    lua_pushlightuserdata(L, &job);
+    lua_pushlightuserdata(L, &results);
+    bool ok = lua_pcall(L, 2, 0, 0) == LUA_OK;
+    std::string message;
+    if (!ok) {
+      const char* msg = lua_tostring(L, -1);
+      message = msg ? msg : "(no message)";
+    }
+    lua_settop(L, 0);
+    postResult(job, ok, results, message);
+  }
+  // Posts the results of job, or the error message if ok is false
+  static void postResult(const Job& job, bool ok, const std::string& results, std::string message) {
+    if (!job.target) return;
+    Ref<Buffer> value;
+    if (ok) {
+      Ref<Buffer>(Buffer::create(results.size())).swap(value);
+      if (!value.get()) {
+        ok = false;
+        message = "wxLanesBridge: Out of memory.";
+      }
+      else {
+        memcpy(value->data(), results.data(), results.size());
+      }
+    }
+    TargetUse use(job.target);
+    if (!use.get()) return; // handle died meanwhile
+    stats().posted(use.get(), 1, ok ? results.size() : message.size());
+    BridgeEvent* event = new BridgeEvent(job.eventType, NULL);
+    event->SetInt((int)job.id);
+    event->SetExtraLong(ok ? 1 : 0);
+    if (ok) event->SetValue(value);
+    else event->SetString(toWxString(message.data(), message.size()));
+    queueEvent(use.get(), event);
+  }
+  void run(size_t idx) {
+    lua_State* L = luaL_newstate();
+    if (L) {
+      luaL_openlibs(L);
+      if (!m_init.empty() && (luaL_loadbuffer(L, m_init.data(), m_init.size(), "=init") != LUA_OK ||
+                              lua_pcall(L, 0, 0, 0) != LUA_OK)) {
+        const char* msg = lua_tostring(L, -1);
+        lua_writestringerror("wxLanesBridge: Error in worker init: %s\n", msg ? msg : "(no message)");
+      }
+      lua_settop(L, 0);
+    }
+    for (;;) {
+      Job job;
+      if (take(idx, job)) {
+        if (L) execute(L, job);
+        else postResult(job, false, std::string(), "wxLanesBridge: Cannot create the worker's Lua state.");
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_queued.load() != 0) continue;
+      if (m_closed) break;
+      m_wake.wait(lock);
+    }
+    if (L) lua_close(L);
+    release();
+  }
+  Worker* m_workers;
+  const size_t m_count;
+  const std::string m_init; // chunk run once in each worker state
+  std::mutex m_mutex;
+  std::condition_variable m_wake; // signalled on submit and close
+  std::atomic<size_t> m_queued; // jobs in all queues
+  std::atomic<size_t> m_next; // round-robin position of submit()
+  std::atomic<lua_Integer> m_lastId;
+  bool m_closed;
+};
+
+// ------------------------------------------------------------------------------
+// Futures
+// ------------------------------------------------------------------------------
+
+// Result of a job, fulfilled by a lane and consumed by a callback or coroutine
+// of the GUI thread (see bridge.future). Starts with two references: one of 
+// the completing side, released when the completion has been taken by the GUI
+// thread, and one of the GUI side, held by the handle and released when the 
+// future has been consumed. Only the GUI thread kills the handle.
+class Future : public RefCounted {
+public:
+  Future() : completed(false), ok(false), done(false), callback(LUA_NOREF), handle(NULL) { addRef(); }
+  std::atomic<bool> completed; // set by the first bridge.fulfil() or bridge.fail()
+  // Written by the completing thread before it queues the future
+  std::string value; // packed
+  std::string error;
+  bool ok;
+  // GUI thread only
+  bool done; // completion taken
+  int callback; // registry reference of the callback function or coroutine
+  void* handle;
+};
+
+// Completed futures not yet taken by the GUI thread. All completions arriving
+// until the GUI thread gets to the host event are handled in one batch.
+static std::mutex s_futuresMutex;
+static std::vector<Future*> s_completed;
+static bool s_futuresScheduled = false;
+
+// Futures with a callback or waiting coroutine, not completed yet (GUI thread).
+// bridge.shutdown() releases them, as they are never completed anymore.
+static std::vector<Future*> s_waiting;
+
+// Kills a future handle and releases the GUI side's reference (GUI thread)
+static void dropFuture(void* handle) {
+  Future* future = removeObject<Future>(handle, OBJECT_FUTURE);
+  if (future) future->release();
+}
+
+// Sets the callback of future, a function or coroutine at the top of the stack
+static void setCallback(lua_State* L, Future* future) {
+  future->callback = luaL_ref(L, LUA_REGISTRYINDEX);
+  if (!future->done) s_waiting.push_back(future);
+}
+
+// Pushes the completion of future as (value) or (nil, error)
+static int pushCompletion(lua_State* L, Future* future) {
+  if (future->ok) {
+    unpackValue(L, future->value.data(), future->value.size());
+    return 1;
+  }
+  lua_pushnil(L);
+  lua_pushlstring(L, future->error.data(), future->error.size());
+  return 2;
+}
+
+// Hands the completion of future to its callback or coroutine (GUI thread) and
+// releases the GUI side's reference
+static int consumeCall(lua_State* L) {
+  Future* future = (Future*)lua_touserdata(L, 1);
+  int callback = future->callback;
+  future->callback = LUA_NOREF;
+  std::vector<Future*>::iterator it = std::find(s_waiting.begin(), s_waiting.end(), future);
+  if (it != s_waiting.end()) s_waiting.erase(it);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, callback);
+  luaL_unref(L, LUA_REGISTRYINDEX, callback);
+  if (lua_isfunction(L, -1)) {
+    lua_call(L, pushCompletion(L, future), 0);
+    return 0;
+  }
+  lua_State* co = lua_tothread(L, -1);
+  int nargs = pushCompletion(L, future);
+  lua_xmove(L, co, nargs);
+  int nresults = 0;
+  int status = lua_resume(co, L, nargs, &nresults);
+  if (status != LUA_OK && status != LUA_YIELD) {
+    lua_xmove(co, L, 1); // error message
+    lua_error(L);
+  }
+  lua_pop(co, nresults);
+  return 0;
+}
+
+static void consumeFuture(lua_State* L, Future* future) {
+  void* handle = future->handle; // the callback may consume the future itself
+  int top = lua_gettop(L);
+  lua_pushcfunction(L, consumeCall);
+  lua_pushlightuserdata(L, future);
+  if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+    // Raising the error here would unwind through wxWidgets
+    const char* msg = lua_tostring(L, -1);
+    lua_writestringerror("wxLanesBridge: Error in future callback: %s\n", msg ? msg : "(no message)");
+  }
+  lua_settop(L, top);
+  dropFuture(handle);
+}
+
+// Takes all completions queued so far and consumes those with a callback or
+// coroutine (GUI thread)
+static void takeCompletions() {
+  std::vector<Future*> completed;
+  {
+    std::lock_guard<std::mutex> lock(s_futuresMutex);
+    completed.swap(s_completed);
+    s_futuresScheduled = false;
+  }
+  for (size_t n = 0; n < completed.size(); n++) {
+    Future* future = completed[n];
+    future->done = true;
+    if (future->callback != LUA_NOREF) consumeFuture(s_guiState, future);
+    future->release(); // of the completing side
+  }
+}
+
+// Payload of the host event delivering a batch of completions
+class FutureBatch : public HostTask {
+public:
+  virtual void run() { takeCompletions(); }
+};
+
+// Queues the completion of future (any thread)
+static void completeFuture(Future* future) {
+  PostGuard guard;
+  if (!guard.ok()) {
+    // Posts closed: the completion is never taken
+    future->release();
+    return;
+  }
+  bool schedule;
+  {
+    std::lock_guard<std::mutex> lock(s_futuresMutex);
+    s_completed.push_back(future);
+    schedule = !s_futuresScheduled;
+    s_futuresScheduled = true;
+  }
+  if (schedule) queueEvent(s_host, new BridgeEvent(s_nativeEventID, new FutureBatch()));
+}
+
+// ------------------------------------------------------------------------------
+// Channels
+// ------------------------------------------------------------------------------
+
+// Event types registered via bridge.registerChannel(), indexed by channel id.
+// Channel 0 is the default event type of bridge.init(). Entries are written by
+// the GUI thread and read lock-free by the lanes.
+#define MAX_CHANNELS 64
+static std::mutex s_channelsMutex;
+static std::map<std::string, int> s_channelIds;
+static std::atomic<wxEventType> s_channels[MAX_CHANNELS];
+static std::atomic<int> s_channelCount(1);
+// Compression thresholds of the channels in bytes, 0 if disabled
+static std::atomic<size_t> s_thresholds[MAX_CHANNELS];
+
+// ------------------------------------------------------------------------------
+// Common argument checks
+
+// Returns the window of a target pointer or handle, NULL for a dead handle
+static wxWindow* resolveTarget(void* ptr) {
+  return HandleRegistry::isHandle(ptr) ? handles().resolve(ptr) : (wxWindow*)ptr;
+}
+
+// Checks the init state and returns the target of a posting function from 
+// argument 1, a pointer or a handle. Raises a Lua error with the name of the 
+// calling function.
+static wxWindow* checkTarget(lua_State* L, const char* fname) {
+  // Ensure the bridge was initialized
+  if (s_defaultEventID.load(std::memory_order_acquire) == wxID_ANY) {
+    luaL_error(L, "wxLanesBridge: Error - Call init() before %s().", fname);
+  }
+  // First (mandatory) argument must be lightuserdata
+  if (!lua_islightuserdata(L, 1)) {
+    luaL_error(L, "wxLanesBridge: Argument 1 must be lightuserdata (e.g. a wxWindow pointer)");
+  }
+  void* ptr = lua_touserdata(L, 1);
+  // A dead handle yields NULL, which the posting functions treat as a no-op,
+  // and so does every target after bridge.shutdown()
+  if (s_closed.load(std::memory_order_relaxed)) return NULL;
+  return resolveTarget(ptr);
+}
+
+// Returns the event type of the optional channel argument at index idx (a 
+// channel id or name, see bridge.registerChannel), or the default event type.
+// Stores the channel's compression threshold in threshold, if given.
+static wxEventType optChannel(lua_State* L, int idx, size_t* threshold = NULL) {
+  int id = -1;
+  int type = lua_type(L, idx);
+  if (type == LUA_TNONE || type == LUA_TNIL) {
+    id = 0;
+  }
+  else if (type == LUA_TSTRING) {
+    std::lock_guard<std::mutex> lock(s_channelsMutex);
+    std::map<std::string, int>::iterator it = s_channelIds.find(lua_tostring(L, idx));
+    if (it != s_channelIds.end()) id = it->second;
+  }
+  else if (lua_isinteger(L, idx)) {
+    lua_Integer value = lua_tointeger(L, idx);
+    if (value >= 0 && value < s_channelCount.load(std::memory_order_acquire)) id = (int)value;
+  }
+  if (id < 0) return (wxEventType)luaL_argerror(L, idx, "unknown channel");
+  if (threshold) *threshold = s_thresholds[id].load(std::memory_order_relaxed);
+  if (id == 0) return s_defaultEventID.load(std::memory_order_relaxed);
+  return s_channels[id].load(std::memory_order_relaxed);
+}
+
+// Returns the number in field name of the table at index idx, or def if the 
+// field is nil
+static lua_Number optNumberField(lua_State* L, int idx, const char* name, lua_Number def) {
+  lua_getfield(L, idx, name);
+  if (!lua_isnil(L, -1)) {
+    if (!lua_isnumber(L, -1)) {
+      luaL_error(L, "wxLanesBridge: Option '%s' must be a number.", name);
+    }
+    def = lua_tonumber(L, -1);
+  }
+  lua_pop(L, 1);
+  return def;
+}
+
+// Returns the event behind argument idx, given either as wxLua userdata 
+// (the event object inside a wxLua event handler) or as lightuserdata.
+static wxEvent* checkEvent(lua_State* L, int idx) {
+  void* ptr = NULL;
+  if (lua_islightuserdata(L, idx)) {
+    ptr = lua_touserdata(L, idx);
+  }
+  else if (lua_isuserdata(L, idx)) {
+    // Same layout as in getPointer(): the C++ address is stored at the
+    // very beginning of the wxLua userdata block.
+    void* ud = lua_touserdata(L, idx);
+    if (ud) ptr = *(void**)ud;
+  }
+  if (!ptr) {
+    luaL_error(L, "wxLanesBridge: Argument %d must be an event (userdata or lightuserdata).", idx);
+  }
+  return (wxEvent*)ptr;
+}
+
+/**
+ * Initializes the wxLanesBridge module by setting the process-wide 
+ * `wxThreadEvent` ID. 
+ * 
+ * This is a necessary requirement when both the wxLua and
+ * wxLanesBridge DLLs are linked against a static version of the wxWidgets library.
+ * In this configuration, each DLL maintains its own static wxWidgets instance.
+ * 
+ * Since wxWidgets' internal event IDs (declared via `wxDECLARE_EVENT()` and 
+ * `wxDEFINE_EVENT()`) are generated dynamically at runtime using `wxNewEventType()`,
+ * the integer values for constants like `wxEVT_THREAD` may differ between the two 
+ * DLLs depending on the order of initialization.
+ *
+ * This function resolves the 
+ * discrepancy by injecting the correct ID from the main GUI thread into the 
+ * bridge's shared memory. It must be called once before any lane attempts 
+ * to use the bridge, ideally immediately after the initial `require` statement, 
+ * as shown in the usage example.
+ * The same applies to the further event types the bridge binds handlers for,
+ * which are passed in the optional options table.
+ *
+ * @function bridge.init
+ * @tparam integer id The runtime-defined `wxEVT_THREAD` ID from wxLua.
+ * @tparam[opt] table options Further event types from wxLua:
+ * @tparam[opt] integer options.destroy `wx.wxEVT_DESTROY`, to invalidate handles (see @{bridge.handle}) when their window is destroyed.
+ * @tparam[opt] integer options.priority Event type of priority events (see @{bridge.postUrgent}), e.g. from `wx.wxNewEventType()`. Defaults to `id`.
+ * @tparam[opt] userdata options.host Window (e.g. the main frame) that executes native operations such as @{bridge.setGaugeValue}. Must live as long as the bridge is used.
+ * @tparam[opt] integer options.native Event type of native operations, e.g. from `wx.wxNewEventType()`. Required with `host`.
+ * @tparam[opt] integer options.idle `wx.wxEVT_IDLE`, to drain targets at idle time (see @{bridge.drain}). Requires `host` and `native`.
+ * @tparam[opt=0] integer options.compress Compression threshold in bytes of the default channel (see @{bridge.registerChannel}), 0 to disable compression.
+ * @treturn table self The bridge module table to allow for method chaining.
+ * @usage
+ * -- In main GUI thread
+ * local wx = require("wx")
+ * local bridge = require("wxLanesBridge").init(wx.wxEVT_THREAD, { destroy = wx.wxEVT_DESTROY })
+ *
+ * -- In worker thread (static ID is already shared in process memory)
+ * local bridge = require("wxLanesBridge")
+ */
+static int init(lua_State* L) {
+  // 1. Extract the Event ID from the first argument and store it.
+  //    This static value is shared across the entire process (and all lanes)
+  //    because that's how static variables in a DLL behave.
+  wxEventType eventID = (wxEventType)luaL_checkinteger(L, 1);
+
+  // Optional argument 2: table of further event types of wxLua's instance
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    s_destroyEventID = (wxEventType)optNumberField(L, 2, "destroy", s_destroyEventID);
+    s_priorityEventID = (wxEventType)optNumberField(L, 2, "priority", s_priorityEventID);
+    wxEventType nativeID = (wxEventType)optNumberField(L, 2, "native", wxEVT_NULL);
+    wxEventType idleID = (wxEventType)optNumberField(L, 2, "idle", wxEVT_NULL);
+    lua_Number threshold = optNumberField(L, 2, "compress", (lua_Number)s_thresholds[0].load());
+    if (threshold < 0) return luaL_error(L, "wxLanesBridge: Option 'compress' must not be negative.");
+    s_thresholds[0].store((size_t)threshold);
+    lua_getfield(L, 2, "host");
+    wxWindow* host = NULL;
+    if (!lua_isnil(L, -1)) {
+      if (!lua_isuserdata(L, -1) || lua_islightuserdata(L, -1) || !lua_touserdata(L, -1)) {
+        return luaL_error(L, "wxLanesBridge: Option 'host' must be a wxLua window.");
+      }
+      host = (wxWindow*)*(void**)lua_touserdata(L, -1);
+    }
+    lua_pop(L, 1);
+    if (host && nativeID != wxEVT_NULL) {
+      // (Re)bind the handlers of native operations and drained targets
+      if (s_host) {
+        s_host->Unbind(wxEventTypeTag<wxThreadEvent>(s_nativeEventID), &onHostEvent);
+        if (s_idleEventID != wxEVT_NULL) {
+          s_host->Unbind(wxEventTypeTag<wxIdleEvent>(s_idleEventID), &onDrainIdle);
+        }
+      }
+      host->Bind(wxEventTypeTag<wxThreadEvent>(nativeID), &onHostEvent);
+      if (idleID != wxEVT_NULL) host->Bind(wxEventTypeTag<wxIdleEvent>(idleID), &onDrainIdle);
+      s_host = host;
+      s_nativeEventID = nativeID;
+      s_idleEventID = idleID;
+    }
+  }
+  s_guiThread = std::this_thread::get_id();
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  s_guiState = lua_tothread(L, -1);
+  lua_pop(L, 1);
+  s_defaultEventID.store(eventID, std::memory_order_release);
+
+  // 2. Return the module table (an upvalue of all module functions) to Lua
+  //    to allow for chaining.
+  lua_pushvalue(L, lua_upvalueindex(UPVALUE_MODULE));
+  return 1;
+}
+
+/**
+ * Registers an event channel.
+ *
+ * By default all bridge traffic uses the single event type passed to 
+ * @{bridge.init}, so one handler per window receives everything and has to 
+ * dispatch in Lua. A channel maps a name to another event type, e.g. from 
+ * `wx.wxNewEventType()`. The posting functions take the channel's id (or name) as
+ * optional last argument and post events of its type, so wxWidgets routes them
+ * directly to the handler connected for that type. Channel 0 is the default 
+ * event type. Registering a name again assigns it the new event type and 
+ * returns the same id. At most 63 channels can be registered.
+ *
+ * Records collected for a target configured via @{bridge.configure} are
+ * delivered on the default channel.
+ *
+ * A channel can compress large payloads: @{bridge.postEvent} and 
+ * @{bridge.postEventBatch} compress the fields `s` and `b` from the channel's
+ * threshold up (unless a data table sets its own threshold in the field 
+ * `compress`). The data stays compressed while queued and is decompressed
+ * only when the GUI thread reads it via @{bridge.getBatch} or 
+ * @{bridge.getBytes}. With a compressed `s`, `event:GetString()` of a 
+ * @{bridge.postEvent} event is empty. The threshold of the default channel
+ * is set via @{bridge.init}.
+ *
+ * @function bridge.registerChannel
+ * @tparam string name Name of the channel.
+ * @tparam integer eventType Event type of the channel's events.
+ * @tparam[opt=0] integer threshold Compression threshold in bytes, 0 to disable compression.
+ * @treturn integer Channel id, to be passed to the lanes.
+ * @raise Throws an error if the arguments are invalid or all channels are in use.
+ * @usage
+ * -- In main GUI thread
+ * local EVT_LOG = wx.wxNewEventType()
+ * local logChannel = bridge.registerChannel("log", EVT_LOG)
+ * logCtrl:Connect(EVT_LOG, function(event) logCtrl:AppendText(event:GetString()) end)
+ *
+ * -- In worker lane
+ * bridge.postEvent(logPtr, { s = "started\n" }, logChannel)
+ */
+static int registerChannel(lua_State* L) {
+  const char* name = luaL_checkstring(L, 1);
+  wxEventType eventType = (wxEventType)luaL_checkinteger(L, 2);
+  lua_Integer threshold = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, threshold >= 0, 3, "threshold must not be negative");
+  int id = -1;
+  {
+    std::lock_guard<std::mutex> lock(s_channelsMutex);
+    std::map<std::string, int>::iterator it = s_channelIds.find(name);
+    if (it != s_channelIds.end()) {
+      id = it->second;
+    }
+    else if (s_channelCount.load() < MAX_CHANNELS) {
+      id = s_channelCount.load();
+      s_channelIds[name] = id;
+    }
+    if (id >= 0) {
+      s_channels[id].store(eventType, std::memory_order_relaxed);
+      s_thresholds[id].store((size_t)threshold, std::memory_order_relaxed);
+      if (id == s_channelCount.load()) s_channelCount.store(id + 1, std::memory_order_release);
+    }
+  }
+  if (id < 0) return luaL_error(L, "wxLanesBridge: Too many channels.");
+  lua_pushinteger(L, id);
+  return 1;
+}
+
+/**
+ * Extracts the raw C++ memory address from a wxLua userdata object.
+ *
+ * This function is essential for cross-thread communication with Lua Lanes. 
+ * Since complex wxLua userdata objects cannot be safely shared between threads 
+ * (Lanes), this function converts them into 'lightuserdata' (a raw C pointer).
+ * The pointer must not be posted to after the object has been destroyed; 
+ * @{bridge.handle} returns a handle that guards against this instead.
+ *
+ * @function bridge.getPointer
+ * @tparam userdata obj The wxLua object (e.g., a wxWindow, wxFrame, or wxButton).
+ * @treturn lightuserdata|nil The raw C++ pointer address, or nil if the extraction fails.
+ * @raise Throws an error if the bridge has not been initialized via @{bridge.init}.
+ * @usage
+ * -- Get a thread-safe pointer to pass into a Lane
+ * local frame = wx.wxFrame(wx.NULL, wx.wxID_ANY, "My Frame")
+ * local ptr = bridge.getPointer(frame)
+ * -- The 'ptr' can now be safely passed as an argument to a lane function.
+ */
+static int getPointer(lua_State* L) {
+  if (s_defaultEventID.load(std::memory_order_acquire) == wxID_ANY) {
+    // throw an error as early as possible if wxLanesBridge is not initalized
+    return luaL_error(L, "wxLanesBridge must be initialized before use.");
+  }
+  if (lua_isuserdata(L, 1)) {
+    // wxLua userdata blocks contain the pointer to the C++ object at the very beginning.
+    // ud is the address of the pointer
+    void* ud = lua_touserdata(L, 1);
+    if (ud) {
+      // Dereference the userdata block to get the actual C++ object address.
+      // Push it as lightuserdata, which is a plain pointer value and Lane-safe.
+      lua_pushlightuserdata(L, *(void**)ud);
+      return 1;
+    }
+  }
+  return 0; // Return nil if extraction fails
+}
+
+/**
+ * Returns a liveness-tracked handle of a wxLua window.
+ *
+ * Like @{bridge.getPointer}, but instead of the raw address the result is a 
+ * generation-counted handle from a registry, which all posting functions 
+ * accept in place of a pointer. When the window is destroyed, the handle dies:
+ * posting to it is then a cheap no-op instead of a use-after-free, so lanes 
+ * need no lock against window teardown. The destruction waits until lanes 
+ * that are just posting to the window have finished.
+ *
+ * Handles are invalidated automatically if `wx.wxEVT_DESTROY` was passed to
+ * @{bridge.init}, otherwise via @{bridge.invalidate}. Asking twice for the 
+ * handle of the same window returns the same handle. At most 4096 windows can
+ * have a live handle at the same time.
+ *
+ * @function bridge.handle
+ * @tparam userdata obj The wxLua window (e.g., a wxFrame, or wxGauge).
+ * @treturn lightuserdata The handle.
+ * @raise Throws an error if the bridge has not been initialized, Argument 1 is not a wxLua object, or all handles are in use.
+ * @usage
+ * -- In main GUI thread
+ * local bridge = require("wxLanesBridge").init(wx.wxEVT_THREAD, { destroy = wx.wxEVT_DESTROY })
+ * local h = bridge.handle(frame)
+ * lanes.gen("*", worker)(h)
+ *
+ * -- In worker lane: returns false once the frame has been closed
+ * bridge.postEvent(h, { i = progress })
+ */
+static int handle(lua_State* L) {
+  if (s_defaultEventID.load(std::memory_order_acquire) == wxID_ANY) {
+    return luaL_error(L, "wxLanesBridge: Error - Call init() before handle().");
+  }
+  if (!lua_isuserdata(L, 1) || lua_islightuserdata(L, 1) || !lua_touserdata(L, 1)) {
+    return luaL_error(L, "wxLanesBridge: Argument 1 must be a wxLua window.");
+  }
+  wxWindow* win = (wxWindow*)*(void**)lua_touserdata(L, 1);
+  bool known = handles().find(win) != NULL;
+  void* h = handles().issue(win);
+  if (!h) return luaL_error(L, "wxLanesBridge: Too many handles.");
+  if (!known && s_destroyEventID != wxEVT_NULL) {
+    win->Bind(wxEventTypeTag<wxWindowDestroyEvent>(s_destroyEventID), &onWindowDestroy);
+  }
+  lua_pushlightuserdata(L, h);
+  return 1;
+}
+
+/**
+ * Invalidates all handles of a window.
+ *
+ * Posts to the handles of the window are no-ops from then on. Waits until 
+ * lanes that are just posting to the window have finished. Called 
+ * automatically when the window is destroyed, if `wx.wxEVT_DESTROY` was passed
+ * to @{bridge.init}. To be called in the GUI thread.
+ *
+ * @function bridge.invalidate
+ * @tparam userdata|lightuserdata obj The wxLua window, or a handle of it.
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is neither a wxLua object nor lightuserdata.
+ * @usage
+ * bridge.invalidate(frame)
+ * frame:Destroy()
+ */
+static int invalidate(lua_State* L) {
+  void* ptr = lua_touserdata(L, 1);
+  if (!ptr) {
+    return luaL_error(L, "wxLanesBridge: Argument 1 must be a wxLua window or a handle.");
+  }
+  wxWindow* win;
+  if (lua_islightuserdata(L, 1)) {
+    win = HandleRegistry::isHandle(ptr) ? handles().resolve(ptr) : (wxWindow*)ptr;
+  }
+  else {
+    win = (wxWindow*)*(void**)ptr;
+  }
+  if (win) handles().invalidate(win);
+  return 0;
+}
+
+/**
+ * Posts a wxThreadEvent to the main GUI thread.
+ * 
+ * This function sends an event to the specified wxWidgets object pointer. It requires 
+ * the bridge to be initialized via @{bridge.init}. The optional data table allows passing 
+ * additional information to the event handler in the GUI thread.
+ *
+ * @function bridge.postEvent
+ * @tparam lightuserdata objPtr The pointer to the target wxLua object (received from the GUI thread).
+ * @tparam[opt] table data Optional data table to populate the event fields:
+ * @tparam[opt] string data.s Maps to `event:SetString()` (UTF-8 supported).
+ * @tparam[opt] integer data.i Maps to `event:SetInt()` (standard command integer).
+ * @tparam[opt] integer data.l Maps to `event:SetExtraLong()` (useful for timestamps or 32-bit IDs).
+ * @tparam[opt] string data.b Raw bytes passed without any conversion, read with @{bridge.getBytes}.
+ * @param[opt] data.value Any Lua value (including nested tables), packed in a compact binary format and read with @{bridge.unpack}.
+ * @tparam[opt] lightuserdata data.buffer Binary buffer handle (see @{bridge.buffer}), read with @{bridge.getBuffer}. The event takes a reference of its own.
+ * @tparam[opt] integer data.compress Compression threshold in bytes for `s` and `b`, overriding the channel's (see @{bridge.registerChannel}); 0 disables compression. A compressed `s` is read with @{bridge.getBatch} only.
+ * @tparam[opt] integer|string channel Channel id or name (see @{bridge.registerChannel}) selecting the event type. Defaults to the type of @{bridge.init}.
+ * @treturn boolean true if the data was queued, false if the bounded queue of the target
+ * (see @{bridge.configure}) was full and the data dropped or rejected, if the target 
+ * handle is dead or once posts are closed (see @{bridge.flush}).
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a table, or if the bridge has not been initialized.
+ * @usage
+ * -- Example: Sending a complex update from a worker lane
+ * bridge.postEvent(objPtr, { 
+ *     s = "Calculation finished", 
+ *     i = 100, 
+ *     l = os.time() 
+ * })
+ *
+ * -- Example: Just triggering the event ("ringing the doorbell")
+ * bridge.postEvent(objPtr)
+ */
+static int postEvent(lua_State* L) {
+  // Check number of arguments (1 to 3: target, data table, channel)
+  int numArgs = lua_gettop(L);
+  if (numArgs < 1 || numArgs > 3) {
+    return luaL_error(L, "wxLanesBridge: Wrong argument count.");
+  }
+
+  // Ensure the bridge was initialized and get address of target widget to 
+  // post the event to
+  wxWindow* win = checkTarget(L, "postEvent");
+
+  // Second (optional) argument must be a table
+  if (numArgs >= 2 && !lua_isnil(L, 2) && !lua_istable(L, 2)) {
+    return luaL_error(L, "wxLanesBridge: Optional argument 2 must be a table.");
+  }
+
+  // Third (optional) argument selects the channel
+  size_t threshold;
+  wxEventType eventType = optChannel(L, 3, &threshold);
+  
+  if (!win) {
+    lua_pushboolean(L, 0); // dead handle or posts closed
+    return 1;
+  }
+
+  // Configured targets (see bridge.configure) collect records instead
+  Target* target = findTarget(win);
+  if (target) {
+    Record rec;
+    if (lua_istable(L, 2)) readRecord(L, 2, rec, threshold);
+    stats().posted(win, 1, recordBytes(rec));
+    int result = DELIVER_REJECTED;
+    {
+      TargetUse use(L, 1);
+      if (use.get()) result = deliver(target, rec, NULL);
+    }
+    target->release();
+    lua_pushboolean(L, result < DELIVER_DROPPED);
+    return 1;
+  }
+  
+  // Optional argument 2: The data table { s="...", i=..., l=... }
+  // Table indices s, i, and l are aligned to the available wxWidgets
+  // member functions for an wxThreadEvent:
+  // void SetExtraLong(long extraLong);
+  // void SetInt(int intCommand);
+  // void SetString(const wxString &string);
+  // All fields are fetched first and left on the stack (this is where Lua
+  // errors may occur), then the event is allocated and filled.
+  const char* str = NULL;
+  size_t len = 0;
+  int i = 0;
+  long l = 0;
+  const char* data = NULL;
+  size_t dataLen = 0;
+  const std::string* packed = NULL;
+  Ref<Buffer> bytes;
+  Ref<Buffer> value;
+  Ref<Buffer> buffer;
+  Ref<Buffer> text;
+  int compressed = 0;
+  if (lua_istable(L, 2)) {
+    // Compression threshold, overrides the channel's
+    threshold = optThreshold(L, 2, threshold);
+
+    // [s]tring
+    getField(L, 2, UPVALUE_S);
+    if (lua_isstring(L, -1)) {
+      str = lua_tolstring(L, -1, &len);
+    }
+
+    // [i]nteger (intCommand)
+    getField(L, 2, UPVALUE_I);
+    if (lua_isnumber(L, -1)) {
+      i = (int)lua_tointeger(L, -1);
+    }
+
+    // [l]ong (extraLong)
+    getField(L, 2, UPVALUE_L);
+    if (lua_isnumber(L, -1)) {
+      l = (long)lua_tointeger(L, -1);
+    }
+
+    // Raw [b]ytes, kept unconverted
+    getField(L, 2, UPVALUE_B);
+    if (lua_isstring(L, -1)) {
+      data = lua_tolstring(L, -1, &dataLen);
+    }
+
+    // Any Lua [value], packed
+    getField(L, 2, UPVALUE_VALUE);
+    if (!lua_isnil(L, -1)) {
+      packed = &packScratch(L, -1);
+    }
+
+    // Binary buffer, shared by all copies of the event
+    readBuffer(L, 2, buffer);
+  }
+  if (threshold && (len >= threshold || dataLen >= threshold)) {
+    // Large strings travel compressed, the event string stays empty
+    static thread_local std::string s_scratch;
+    if (str && len >= threshold && compress(str, len, s_scratch)) {
+      Ref<Buffer>(Buffer::create(s_scratch.size())).swap(text);
+      if (!text.get()) return luaL_error(L, "wxLanesBridge: Out of memory.");
+      memcpy(text->data(), s_scratch.data(), s_scratch.size());
+      compressed |= COMPRESSED_S;
+      str = NULL;
+      len = text->size();
+    }
+    if (data && dataLen >= threshold && compress(data, dataLen, s_scratch)) {
+      Ref<Buffer>(Buffer::create(s_scratch.size())).swap(bytes);
+      if (!bytes.get()) return luaL_error(L, "wxLanesBridge: Out of memory.");
+      memcpy(bytes->data(), s_scratch.data(), s_scratch.size());
+      compressed |= COMPRESSED_B;
+      data = NULL;
+      dataLen = bytes->size();
+    }
+  }
+  if (data) {
+    Ref<Buffer>(Buffer::create(dataLen)).swap(bytes);
+    if (!bytes.get()) return luaL_error(L, "wxLanesBridge: Out of memory.");
+    memcpy(bytes->data(), data, dataLen);
+  }
+  if (packed) {
+    Ref<Buffer>(Buffer::create(packed->size())).swap(value);
+    if (!value.get()) return luaL_error(L, "wxLanesBridge: Out of memory.");
+    memcpy(value->data(), packed->data(), packed->size());
+  }
+
+  stats().posted(win, 1, len + dataLen + (packed ? packed->size() : 0) +
+                 (buffer.get() ? buffer->size() : 0));
+
+  // The target window stays alive until the event is queued
+  TargetUse use(L, 1);
+  if (!use.get()) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+
+  // Create new event and hand it over to the target's queue
+  BridgeEvent* event = new BridgeEvent(eventType, NULL);
+  if (str) event->SetString(toWxString(str, len));
+  event->SetInt(i);
+  event->SetExtraLong(l);
+  event->SetBytes(bytes);
+  event->SetValue(value);
+  event->SetBuffer(buffer);
+  event->SetText(text);
+  event->SetCompressed(compressed);
+  queueEvent(win, event);
+  
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// Posts i, l and the optional string of len bytes at str to the target ptr (a 
+// pointer or a handle) resolved to win. Shared by bridge.post() and 
+// wxLanesBridge_post(), so it must not touch a Lua state. Returns true if the
+// data was queued.
+static bool postPlain(void* ptr, wxWindow* win, wxEventType eventType, 
+                      int i, long l, const char* str, size_t len) {
+  stats().posted(win, 1, len);
+
+  // Configured targets (see bridge.configure) collect records instead
+  Target* target = findTarget(win);
+  if (target) {
+    Record rec;
+    rec.i = i;
+    rec.l = l;
+    if (str) {
+      rec.s.assign(str, len);
+      rec.hasS = true;
+    }
+    int result = DELIVER_REJECTED;
+    {
+      TargetUse use(ptr);
+      if (use.get()) result = deliver(target, rec, NULL);
+    }
+    target->release();
+    return result < DELIVER_DROPPED;
+  }
+
+  TargetUse use(ptr);
+  if (!use.get()) return false;
+  BridgeEvent* event = new BridgeEvent(eventType, NULL);
+  if (str) event->SetString(toWxString(str, len));
+  event->SetInt(i);
+  event->SetExtraLong(l);
+  queueEvent(win, event);
+  return true;
+}
+
+/**
+ * Posts a wxThreadEvent to the main GUI thread, passing the data as arguments.
+ *
+ * Same as @{bridge.postEvent}, but the values are passed positionally instead
+ * of in a data table. This avoids creating a table in the lane for every event
+ * (less garbage for the lane's collector) and the field lookups. C/C++ code
+ * in a lane can call the plain C function `wxLanesBridge_post()` of 
+ * `wxLanesBridge.h` instead.
+ *
+ * @function bridge.post
+ * @tparam lightuserdata objPtr The pointer to the target wxLua object (received from the GUI thread).
+ * @tparam[opt] integer i Maps to `event:SetInt()`.
+ * @tparam[opt] integer l Maps to `event:SetExtraLong()`.
+ * @tparam[opt] string s Maps to `event:SetString()`.
+ * @tparam[opt] integer|string channel Channel id or name (see @{bridge.registerChannel}) selecting the event type. Defaults to the type of @{bridge.init}.
+ * @treturn boolean true if the data was queued, false if it was dropped or rejected by a full queue (see @{bridge.configure}), if the target handle is dead or once posts are closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata or if the bridge has not been initialized.
+ * @usage
+ * -- In worker lane
+ * bridge.post(objPtr, 100, os.time(), "Calculation finished")
+ */
+static int post(lua_State* L) {
+  wxWindow* win = checkTarget(L, "post");
+  int i = (int)luaL_optinteger(L, 2, 0);
+  long l = (long)luaL_optinteger(L, 3, 0);
+  size_t len = 0;
+  const char* str = luaL_optlstring(L, 4, NULL, &len);
+  wxEventType eventType = optChannel(L, 5);
+  if (!win) {
+    lua_pushboolean(L, 0); // dead handle or posts closed
+    return 1;
+  }
+  lua_pushboolean(L, postPlain(lua_touserdata(L, 1), win, eventType, i, l, str, len));
+  return 1;
+}
+
+// Plain C entry point of bridge.post(), see wxLanesBridge.h
+extern "C" WXLANESBRIDGE_API int wxLanesBridge_post(void* target, int i, long l, const char* s, size_t len) {
+  // Same checks as checkTarget(), reported via the return value
+  wxEventType eventType = s_defaultEventID.load(std::memory_order_acquire);
+  if (eventType == wxID_ANY || !target) return -1;
+  wxWindow* win = resolveTarget(target);
+  if (!win) return 0;
+  return postPlain(target, win, eventType, i, l, s, len) ? 1 : 0;
+}
+
+/**
+ * Posts a high-priority record to the main GUI thread.
+ *
+ * User-facing notifications (errors, completion, ...) must not wait behind 
+ * thousands of queued progress events. An urgent record is kept in a separate 
+ * queue of the target, and the next call of @{bridge.getBatch} for the target
+ * returns all urgent records first, flagged with `urgent = true`, no matter 
+ * which bridge event it is called for. In addition, a priority event is 
+ * queued for the target, using the event type passed as `priority` to 
+ * @{bridge.init}, so a dedicated handler can be bound for it. If the urgent 
+ * records have already been handed out when it arrives, its batch is empty.
+ *
+ * Urgent records bypass the pacing and the queue bound of @{bridge.configure}.
+ *
+ * @function bridge.postUrgent
+ * @tparam lightuserdata objPtr The pointer to the target wxLua object, or a handle (see @{bridge.handle}).
+ * @tparam[opt] table data Optional data table with the fields `s`, `i`, `l`, `b`, `value` and `buffer` as in @{bridge.postEvent}.
+ * @treturn boolean `true` if the record was queued, `false` if the target handle is dead or once posts are closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a table, or if the bridge has not been initialized.
+ * @usage
+ * -- In main GUI thread
+ * local EVT_URGENT = wx.wxNewEventType()
+ * local bridge = require("wxLanesBridge").init(wx.wxEVT_THREAD, { priority = EVT_URGENT })
+ * local function onBridge(event)
+ *   for _, rec in ipairs(bridge.getBatch(event)) do
+ *     if rec.urgent then wx.wxMessageBox(rec.s) else --[[ progress ]] end
+ *   end
+ * end
+ * frame:Connect(wx.wxEVT_THREAD, onBridge)
+ * frame:Connect(EVT_URGENT, onBridge)
+ *
+ * -- In worker lane
+ * bridge.postUrgent(objPtr, { s = "Job failed: " .. err })
+ */
+static int postUrgent(lua_State* L) {
+  wxWindow* win = checkTarget(L, "postUrgent");
+  if (!lua_isnoneornil(L, 2)) luaL_checktype(L, 2, LUA_TTABLE);
+  if (!win) {
+    lua_pushboolean(L, 0); // dead handle or posts closed
+    return 1;
+  }
+
+  Record rec;
+  if (lua_istable(L, 2)) readRecord(L, 2, rec);
+  stats().posted(win, 1, recordBytes(rec));
+
+  // The target window stays alive until the record is queued
+  TargetUse use(L, 1);
+  if (!use.get()) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+
+  unsigned ticket = 0;
+  {
+    std::lock_guard<std::mutex> lock(s_urgentMutex);
+    UrgentQueue& queue = s_urgent[win];
+    queue.records.push_back(Record());
+    std::swap(queue.records.back(), rec);
+    s_urgentPending.fetch_add(1, std::memory_order_release);
+    if (!queue.scheduled) {
+      queue.scheduled = true;
+      queue.ticket = ticket = ++s_urgentTicket;
+    }
+  }
+  if (ticket) {
+    wxEventType type = s_priorityEventID != wxEVT_NULL ? s_priorityEventID : s_defaultEventID.load();
+    queueEvent(win, new BridgeEvent(type, new UrgentPayload(win, ticket)));
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/**
+ * Posts a list of values to the main GUI thread.
+ *
+ * Sends up to 16 values (nil, booleans, integers, floating-point numbers, 
+ * strings and lightuserdata) with one event. The values are stored in a 
+ * compact, fixed-layout payload, keeping integers and floats apart, so no 
+ * table is needed on either side. The GUI thread gets the values back with
+ * @{bridge.getValues}. @{bridge.getBatch} returns them as a single record 
+ * with the values at indices 1 to n and the field `n`.
+ *
+ * The values bypass the queue of targets configured via @{bridge.configure},
+ * so postv() is rejected for them (and counted as dropped): use
+ * @{bridge.postEvent} with a `value` field instead.
+ *
+ * @function bridge.postv
+ * @tparam lightuserdata objPtr The pointer to the target wxLua object (received from the GUI thread).
+ * @param ... The values to send.
+ * @treturn boolean `true` if the values were queued, `false` if the target is configured, its handle is dead or posts are closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata, a value is of an unsupported type, more than 16 values are given, or if the bridge has not been initialized.
+ * @usage
+ * -- In worker lane
+ * bridge.postv(objPtr, "sample", channel, 0.25, 1.5e-3)
+ *
+ * -- In main GUI thread
+ * local kind, channel, x, y = bridge.getValues(event)
+ */
+static int postv(lua_State* L) {
+  wxWindow* win = checkTarget(L, "postv");
+  int last = lua_gettop(L);
+  if (last - 1 > MAX_VALUES) {
+    return luaL_error(L, "wxLanesBridge: postv() takes at most %d values.", MAX_VALUES);
+  }
+  for (int idx = 2; idx <= last; idx++) {
+    int type = lua_type(L, idx);
+    if (type != LUA_TNIL && type != LUA_TBOOLEAN && type != LUA_TNUMBER &&
+        type != LUA_TSTRING && type != LUA_TLIGHTUSERDATA) {
+      return luaL_argerror(L, idx, "unsupported value type");
+    }
+  }
+  if (!win) {
+    lua_pushboolean(L, 0); // dead handle or posts closed
+    return 1;
+  }
+
+  // Configured targets only take records (see bridge.configure)
+  Target* target = findTarget(win);
+  if (target) {
+    target->release();
+    stats().drop(win);
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+
+  TargetUse use(L, 1);
+  if (!use.get()) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  ValuesPayload* payload = ValuesPayload::create();
+  stats().posted(win, 1, payload->read(L, 2, last));
+  BridgeEvent* event = new BridgeEvent(s_defaultEventID, payload);
+  event->SetInt(payload->count);
+  queueEvent(win, event);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/**
+ * Returns the values of an event sent via @{bridge.postv}.
+ *
+ * To be called in the GUI thread from within the event handler.
+ *
+ * @function bridge.getValues
+ * @tparam userdata event The event object passed to the wxLua event handler.
+ * @return ... The values in the order they were posted (none for other events).
+ * @raise Throws an error if Argument 1 is not an event.
+ */
+static int getValues(lua_State* L) {
+  BridgeEvent* event = dynamic_cast<BridgeEvent*>(checkEvent(L, 1));
+  if (!event) return 0;
+  ValuesPayload* payload = dynamic_cast<ValuesPayload*>(event->GetPayload());
+  if (!payload) return 0;
+  return payload->pushValues(L);
+}
+
+/**
+ * Posts many data records to the main GUI thread with a single wxThreadEvent.
+ *
+ * Instead of one event per record, all records are collected into one payload
+ * which is attached to a single event. This costs one queue insertion in 
+ * wxWidgets and one handler call in the GUI thread, no matter how many records
+ * are sent. The GUI thread reads the records back with @{bridge.getBatch}.
+ * `event:GetInt()` of the posted event holds the number of records.
+ *
+ * @function bridge.postEventBatch
+ * @tparam lightuserdata objPtr The pointer to the target wxLua object (received from the GUI thread).
+ * @tparam table records Array of data tables, each with the optional fields `s`, `i` and `l` as in @{bridge.postEvent}.
+ * @tparam[opt] integer|string channel Channel id or name (see @{bridge.registerChannel}) selecting the event type and compression threshold. Defaults to the type of @{bridge.init}.
+ * @treturn integer Number of records queued, less than the number sent if a full queue dropped or rejected some (see @{bridge.configure}).
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a table, or if the bridge has not been initialized.
+ * @usage
+ * -- In worker lane: collect log lines and send them in one go
+ * local batch = {}
+ * for n = 1, 100 do
+ *   batch[#batch + 1] = { s = "Step " .. n, i = n }
+ * end
+ * bridge.postEventBatch(objPtr, batch)
+ */
+static int postEventBatch(lua_State* L) {
+  wxWindow* win = checkTarget(L, "postEventBatch");
+  luaL_checktype(L, 2, LUA_TTABLE);
+  size_t threshold;
+  wxEventType eventType = optChannel(L, 3, &threshold);
+  if (!win) return 0; // Safety check
+
+  int count = (int)lua_rawlen(L, 2);
+  std::vector<Record> records(count);
+  for (int n = 0; n < count; n++) {
+    lua_rawgeti(L, 2, n + 1);
+    if (lua_istable(L, -1)) {
+      readRecord(L, lua_gettop(L), records[n], threshold);
+    }
+    lua_pop(L, 1);	// pops the record table
+  }
+  size_t size = 0;
+  for (int n = 0; n < count; n++) size += recordBytes(records[n]);
+  stats().posted(win, count, size);
+
+  // The target window stays alive until the records are queued
+  TargetUse use(L, 1);
+  if (!use.get()) {
+    lua_pushinteger(L, 0);
+    return 1;
+  }
+
+  // Configured targets (see bridge.configure) collect records instead
+  Target* target = findTarget(win);
+  if (target) {
+    int queued = 0;
+    for (int n = 0; n < count; n++) {
+      if (deliver(target, records[n], NULL) < DELIVER_DROPPED) queued++;
+    }
+    target->release();
+    lua_pushinteger(L, queued);
+    return 1;
+  }
+
+  BatchPayload* payload = BatchPayload::create();
+  payload->records.swap(records);
+
+  // The event takes over the payload
+  BridgeEvent* event = new BridgeEvent(eventType, payload);
+  event->SetInt(count);
+  queueEvent(win, event);
+
+  lua_pushinteger(L, count);
+  return 1;
+}
+
+/**
+ * Reads all data records carried by a bridge event.
+ *
+ * To be called in the GUI thread from within the event handler. For events 
+ * sent via @{bridge.postEventBatch} this returns all records of the batch. 
+ * For events sent via @{bridge.postEvent} a single record holding the event's 
+ * string, integer and long value is returned, so one handler can process both 
+ * kinds of events alike. Urgent records of the event's target (see 
+ * @{bridge.postUrgent}) precede all others and are flagged with `urgent = true`.
+ *
+ * @function bridge.getBatch
+ * @tparam userdata event The event object passed to the wxLua event handler.
+ * @treturn table Array of records `{ s = ..., i = ..., l = ... }`.
+ * @treturn integer Number of records.
+ * @raise Throws an error if Argument 1 is not an event.
+ * @usage
+ * frame:Connect(wx.wxEVT_THREAD, function(event)
+ *   local records = bridge.getBatch(event)
+ *   for _, rec in ipairs(records) do
+ *     textCtrl:AppendText(rec.s .. "\n")
+ *   end
+ * end)
+ */
+static int getBatch(lua_State* L) {
+  wxEvent* event = checkEvent(L, 1);
+  Clock::time_point start;
+  if (TRACING()) start = Clock::now();
+  int n = 0;
+  lua_newtable(L);
+  BridgeEvent* bridgeEvent = dynamic_cast<BridgeEvent*>(event);
+  // Urgent records of the target (see bridge.postUrgent) come first
+  if (bridgeEvent && bridgeEvent->GetTarget()) {
+    n = pushUrgent(L, bridgeEvent->GetTarget(), n);
+    if (dynamic_cast<UrgentPayload*>(bridgeEvent->GetPayload())) {
+      lua_pushinteger(L, n);
+      return 2;
+    }
+  }
+  if (bridgeEvent && bridgeEvent->GetPayload()) {
+    n = bridgeEvent->GetPayload()->pushRecords(L, n);
+  }
+  else {
+    wxThreadEvent* threadEvent = dynamic_cast<wxThreadEvent*>(event);
+    if (threadEvent) {
+      Record rec;
+      if (bridgeEvent && bridgeEvent->GetText().get()) {
+        // Stays compressed until pushRecord()
+        const Ref<Buffer>& text = bridgeEvent->GetText();
+        rec.s.assign((const char*)text->data(), text->size());
+      }
+      else {
+        wxScopedCharBuffer utf8 = threadEvent->GetString().utf8_str();
+        rec.s.assign(utf8.data(), utf8.length());
+      }
+      rec.hasS = true;
+      rec.i = threadEvent->GetInt();
+      rec.l = threadEvent->GetExtraLong();
+      if (bridgeEvent) {
+        rec.compressed = bridgeEvent->GetCompressed();
+        const Ref<Buffer>& bytes = bridgeEvent->GetBytes();
+        if (bytes.get()) {
+          rec.b.assign((const char*)bytes->data(), bytes->size());
+          rec.hasB = true;
+        }
+        const Ref<Buffer>& value = bridgeEvent->GetValue();
+        if (value.get()) rec.value.assign((const char*)value->data(), value->size());
+        rec.buffer = bridgeEvent->GetBuffer();
+      }
+      pushRecord(L, rec);
+      lua_rawseti(L, -2, ++n);
+    }
+  }
+  traceSpan(TRACE_BATCH, bridgeEvent ? bridgeEvent->GetTarget() : NULL, (unsigned long long)n, start);
+  lua_pushinteger(L, n);
+  return 2;
+}
+
+/**
+ * Posts a value to the main GUI thread, replacing any undelivered value with the same key.
+ *
+ * Meant for status information where only the newest value matters (e.g.
+ * a progress percentage). For each combination of target object and key at 
+ * most one event is under way at any time: while the GUI thread has not yet 
+ * handled it, further calls only overwrite the pending value. Queue depth and
+ * GUI load are thus bounded by the number of keys, regardless of how fast the
+ * lanes post.
+ *
+ * The GUI thread reads the newest value with @{bridge.getBatch}, which returns 
+ * one record with the additional field `k` holding the key. Values are taken 
+ * out of the slot when read, so an event handled after a later value was 
+ * already read returns an empty batch.
+ *
+ * @function bridge.postLatest
+ * @tparam lightuserdata objPtr The pointer to the target wxLua object (received from the GUI thread).
+ * @tparam string|integer key Coalescing key, e.g. the name of the status value.
+ * @tparam[opt] table data Optional data table with the fields `s`, `i` and `l` as in @{bridge.postEvent}.
+ * @tparam[opt] integer|string channel Channel id or name (see @{bridge.registerChannel}) selecting the event type. Defaults to the type of @{bridge.init}.
+ * @treturn boolean|nil `true` if a new event was posted, `false` if an undelivered value was replaced,
+ * nil if the value was not delivered: dropped or rejected by a full queue (see @{bridge.configure}), 
+ * for a dead target handle or once posts are closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a string or number, or if the bridge has not been initialized.
+ * @usage
+ * -- In worker lane
+ * for n = 1, total do
+ *   -- ...
+ *   bridge.postLatest(objPtr, "progress", { i = n * 100 // total })
+ * end
+ *
+ * -- In main GUI thread
+ * frame:Connect(wx.wxEVT_THREAD, function(event)
+ *   for _, rec in ipairs(bridge.getBatch(event)) do
+ *     if rec.k == "progress" then gauge:SetValue(rec.i) end
+ *   end
+ * end)
+ */
+static int postLatest(lua_State* L) {
+  wxWindow* win = checkTarget(L, "postLatest");
+  size_t len;
+  const char* key = luaL_checklstring(L, 2, &len);
+  luaL_argcheck(L, len > 0, 2, "key must not be empty");
+  if (!lua_isnoneornil(L, 3)) luaL_checktype(L, 3, LUA_TTABLE);
+  wxEventType eventType = optChannel(L, 4);
+  if (!win) return 0; // Safety check
+
+  Record rec;
+  if (lua_istable(L, 3)) readRecord(L, 3, rec);
+  rec.k.assign(key, len);
+  stats().posted(win, 1, recordBytes(rec));
+
+  // The target window stays alive until the value is queued
+  TargetUse use(L, 1);
+  if (!use.get()) return 0;
+
+  // Configured targets (see bridge.configure) coalesce within their queue
+  Target* target = findTarget(win);
+  if (target) {
+    std::string slotKey(rec.k);
+    int result = deliver(target, rec, &slotKey);
+    target->release();
+    if (result >= DELIVER_DROPPED) return 0;
+    lua_pushboolean(L, result == DELIVER_ADDED);
+    return 1;
+  }
+
+  LatestKey slotKey(win, rec.k);
+  unsigned ticket;
+  {
+    std::lock_guard<std::mutex> lock(s_latestMutex);
+    std::map<LatestKey, LatestSlot>::iterator it = s_latestSlots.find(slotKey);
+    if (it != s_latestSlots.end()) {
+      // Event still under way: just replace the value
+      std::swap(it->second.rec, rec);
+      lua_pushboolean(L, 0);
+      return 1;
+    }
+    ticket = ++s_latestTicket;
+    LatestSlot& slot = s_latestSlots[slotKey];
+    std::swap(slot.rec, rec);
+    slot.ticket = ticket;
+  }
+
+  queueEvent(win, new BridgeEvent(eventType, new LatestPayload(slotKey, ticket)));
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// Userdata of bridge.group(): the target pointers or handles
+struct Group {
+  size_t count;
+  void* targets[1];
+};
+
+/**
+ * Creates a group of target objects to post the same data to.
+ *
+ * Dashboards often have many panels subscribed to the same feed. Instead of 
+ * calling @{bridge.postEvent} per panel, which converts the same string and
+ * copies the same data each time, `group:post(data)` reads and converts the 
+ * data once and shares it by reference across the events of all recipients.
+ * The group is a userdata of the Lua state that created it, usually built in 
+ * the lane from pointers or handles passed to it. `#group` is the number of 
+ * targets.
+ *
+ * @function bridge.group
+ * @tparam table targets Array of target pointers (see @{bridge.getPointer}) or handles (see @{bridge.handle}).
+ * @treturn userdata The group.
+ * @raise Throws an error if the bridge has not been initialized or an entry of Argument 1 is not lightuserdata.
+ * @usage
+ * -- In worker lane, given the handles of the panels
+ * local panels = bridge.group(panelHandles)
+ * for _, sample in ipairs(feed) do
+ *   panels:post({ s = sample.label, value = sample.data })
+ * end
+ */
+static int group(lua_State* L) {
+  if (s_defaultEventID.load(std::memory_order_acquire) == wxID_ANY) {
+    return luaL_error(L, "wxLanesBridge: Error - Call init() before group().");
+  }
+  luaL_checktype(L, 1, LUA_TTABLE);
+  size_t count = lua_rawlen(L, 1);
+  for (size_t n = 1; n <= count; n++) {
+    if (lua_rawgeti(L, 1, (lua_Integer)n) != LUA_TLIGHTUSERDATA) {
+      return luaL_error(L, "wxLanesBridge: Group entry %d must be lightuserdata.", (int)n);
+    }
+    lua_pop(L, 1);
+  }
+  Group* grp = (Group*)lua_newuserdata(L, sizeof(Group) + (count ? count - 1 : 0) * sizeof(void*));
+  grp->count = count;
+  for (size_t n = 0; n < count; n++) {
+    lua_rawgeti(L, 1, (lua_Integer)(n + 1));
+    grp->targets[n] = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+  }
+  luaL_setmetatable(L, TARGET_GROUP);
+  return 1;
+}
+
+/**
+ * Posts the same data to all targets of a group.
+ *
+ * The data table is read once. The string is converted once, and bytes, 
+ * packed value and buffer are shared by all events. Targets configured with
+ * @{bridge.configure} get the record queued as by @{bridge.postEvent}; dead 
+ * handles are skipped.
+ *
+ * @function group:post
+ * @tparam[opt] table data Optional data table with the fields `s`, `i`, `l`, `b`, `value` and `buffer` as in @{bridge.postEvent}. Each event takes a reference of its own to the buffer, so the caller keeps the handle.
+ * @tparam[opt] integer|string channel Channel id or name (see @{bridge.registerChannel}) selecting the event type. Defaults to the type of @{bridge.init}.
+ * @treturn integer Number of targets the data was queued for.
+ * @raise Throws an error if the group is invalid or Argument 2 is not a table.
+ */
+static int groupPost(lua_State* L) {
+  Group* grp = (Group*)luaL_checkudata(L, 1, TARGET_GROUP);
+  if (!lua_isnoneornil(L, 2)) luaL_checktype(L, 2, LUA_TTABLE);
+  wxEventType eventType = optChannel(L, 3);
+  Record rec;
+  if (lua_istable(L, 2)) readRecord(L, 2, rec);
+
+  // Everything shared by the events of all recipients
+  wxString str;
+  if (rec.hasS) str = toWxString(rec.s.data(), rec.s.size());
+  Ref<Buffer> bytes;
+  Ref<Buffer> value;
+  if (rec.hasB) {
+    Ref<Buffer>(Buffer::create(rec.b.size())).swap(bytes);
+    if (!bytes.get()) return luaL_error(L, "wxLanesBridge: Out of memory.");
+    memcpy(bytes->data(), rec.b.data(), rec.b.size());
+  }
+  if (!rec.value.empty()) {
+    Ref<Buffer>(Buffer::create(rec.value.size())).swap(value);
+    if (!value.get()) return luaL_error(L, "wxLanesBridge: Out of memory.");
+    memcpy(value->data(), rec.value.data(), rec.value.size());
+  }
+  size_t size = recordBytes(rec);
+
+  int queued = 0;
+  for (size_t n = 0; n < grp->count; n++) {
+    TargetUse use(grp->targets[n]);
+    wxWindow* win = use.get();
+    if (!win) continue;
+    stats().posted(win, 1, size);
+    Target* target = findTarget(win);
+    if (target) {
+      Record copy(rec);
+      if (deliver(target, copy, NULL) < DELIVER_DROPPED) queued++;
+      target->release();
+      continue;
+    }
+    BridgeEvent* event = new BridgeEvent(eventType, NULL);
+    if (rec.hasS) event->SetString(str);
+    event->SetInt(rec.i);
+    event->SetExtraLong(rec.l);
+    event->SetBytes(bytes);
+    event->SetValue(value);
+    event->SetBuffer(rec.buffer);
+    queueEvent(win, event);
+    queued++;
+  }
+  lua_pushinteger(L, queued);
+  return 1;
+}
+
+static int groupSize(lua_State* L) {
+  Group* grp = (Group*)luaL_checkudata(L, 1, TARGET_GROUP);
+  lua_pushinteger(L, (lua_Integer)grp->count);
+  return 1;
+}
+
+static const luaL_Reg group_funcs[] = {
+  {"post", groupPost},
+  {NULL, NULL}
+};
+
+// Coalescing state of a poster, shared with its events
+class PosterState : public RefCounted {
+public:
+  PosterState() : underway(false) {}
+  std::mutex mutex;
+  Record rec; // newest values, reused by every send
+  bool underway; // event posted, values not read yet
+};
+
+// Payload of a coalescing poster's event. Reading it takes the newest values
+// and re-arms the poster, so the next send posts again. If the handler does 
+// not read the values, the poster is re-armed when the event is deleted.
+class PosterPayload : public Payload {
+public:
+  PosterPayload(PosterState* state) : m_state(state), m_drained(false) { m_state->addRef(); }
+  virtual ~PosterPayload() {
+    if (!m_drained) {
+      std::lock_guard<std::mutex> lock(m_state->mutex);
+      m_state->underway = false;
+    }
+    m_state->release();
+  }
+  virtual int pushRecords(lua_State* L, int n) {
+    if (m_drained) return n;
+    m_drained = true;
+    Record rec;
+    {
+      std::lock_guard<std::mutex> lock(m_state->mutex);
+      rec = m_state->rec;
+      m_state->underway = false;
+    }
+    pushRecord(L, rec);
+    lua_rawseti(L, -2, ++n);
+    return n;
+  }
+private:
+  PosterState* m_state;
+  bool m_drained;
+};
+
+// Userdata of bridge.poster(), owned by the Lua state that created it
+struct Poster {
+  void* target; // pointer or handle
+  wxEventType eventType;
+  PosterState* state; // NULL unless coalescing
+  lua_Integer sent;
+  lua_Integer coalesced;
+  lua_Integer rejected;
+};
+
+/**
+ * Creates a poster: a sender bound to one target object.
+ *
+ * The target, the channel and the init state are checked once here instead of
+ * on every call, which makes `poster:send()` the cheapest way to post from hot 
+ * worker loops. The poster keeps its own counters (see `poster:stats()`).
+ *
+ * A coalescing poster has at most one event under way. Values sent meanwhile
+ * overwrite the pending ones in the poster's own record, so the GUI thread 
+ * only sees the newest, read with @{bridge.getBatch}. Without coalescing, the
+ * values are posted as with @{bridge.post}. Targets configured with 
+ * @{bridge.configure} get the values queued in either case.
+ *
+ * The poster is a userdata of the Lua state that created it, usually the lane.
+ *
+ * @function bridge.poster
+ * @tparam lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of the target.
+ * @tparam[opt] table options Poster options:
+ * @tparam[opt] integer|string options.channel Channel id or name (see @{bridge.registerChannel}) selecting the event type. Defaults to the type of @{bridge.init}.
+ * @tparam[opt=false] boolean options.coalesce Keep only the newest values while an event is under way.
+ * @treturn userdata|nil The poster, nil for a dead handle or once posts are closed (see @{bridge.flush}).
+ * @raise Throws an error if Argument 1 is not lightuserdata, an option is invalid, or if the bridge has not been initialized.
+ * @usage
+ * -- In worker lane
+ * local progress = bridge.poster(gaugePtr, { coalesce = true })
+ * for n = 1, total do
+ *   -- ...
+ *   progress:send(n, 0, "working")
+ * end
+ */
+static int poster(lua_State* L) {
+  wxWindow* win = checkTarget(L, "poster");
+  wxEventType eventType = s_defaultEventID.load(std::memory_order_relaxed);
+  bool coalesce = false;
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "channel");
+    eventType = optChannel(L, lua_gettop(L));
+    lua_pop(L, 1);
+    lua_getfield(L, 2, "coalesce");
+    coalesce = lua_toboolean(L, -1) != 0;
+    lua_pop(L, 1);
+  }
+  if (!win) return 0; // dead handle or posts closed
+  Poster* p = (Poster*)lua_newuserdata(L, sizeof(Poster));
+  p->target = lua_touserdata(L, 1);
+  p->eventType = eventType;
+  p->state = NULL;
+  p->sent = p->coalesced = p->rejected = 0;
+  luaL_setmetatable(L, POSTER);
+  if (coalesce) p->state = new PosterState();
+  return 1;
+}
+
+// Returns the poster at index 1. Compares its metatable with upvalue 1 of the
+// poster methods, which is cheaper than luaL_checkudata().
+static Poster* checkPoster(lua_State* L) {
+  Poster* p = (Poster*)lua_touserdata(L, 1);
+  if (!p || !lua_getmetatable(L, 1) || !lua_rawequal(L, -1, lua_upvalueindex(1))) {
+    luaL_typeerror(L, 1, POSTER);
+  }
+  lua_pop(L, 1);
+  return p;
+}
+
+/**
+ * Sends values through a poster.
+ *
+ * The arguments are in the order of @{bridge.post}.
+ *
+ * @function poster:send
+ * @tparam[opt] integer i Maps to `event:SetInt()`.
+ * @tparam[opt] integer l Maps to `event:SetExtraLong()`.
+ * @tparam[opt] string s Maps to `event:SetString()`.
+ * @treturn boolean true if the values were queued (or replaced pending ones), false if they were dropped or rejected by a full queue (see @{bridge.configure}) or the target's handle is dead.
+ * @raise Throws an error if an argument is invalid.
+ * @usage
+ * poster:send(42, 0, "sample")
+ */
+static int posterSend(lua_State* L) {
+  Poster* p = checkPoster(L);
+  int i = (int)luaL_optinteger(L, 2, 0);
+  long l = (long)luaL_optinteger(L, 3, 0);
+  size_t len = 0;
+  const char* str = luaL_optlstring(L, 4, NULL, &len);
+
+  // The target window stays alive until the values are queued
+  TargetUse use(p->target);
+  wxWindow* win = use.get();
+  if (!win) {
+    p->rejected++;
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  stats().posted(win, 1, len);
+
+  // Configured targets (see bridge.configure) collect records instead
+  Target* target = findTarget(win);
+  if (target) {
+    Record rec;
+    rec.i = i;
+    rec.l = l;
+    if (str) {
+      rec.s.assign(str, len);
+      rec.hasS = true;
+    }
+    int result = deliver(target, rec, NULL);
+    target->release();
+    bool ok = result < DELIVER_DROPPED;
+    if (ok) p->sent++;
+    else p->rejected++;
+    lua_pushboolean(L, ok);
+    return 1;
+  }
+
+  p->sent++;
+  if (p->state) {
+    bool underway;
+    {
+      std::lock_guard<std::mutex> lock(p->state->mutex);
+      Record& rec = p->state->rec;
+      rec.i = i;
+      rec.l = l;
+      rec.hasS = (str != NULL);
+      rec.s.assign(str ? str : "", len); // reuses the capacity
+      underway = p->state->underway;
+      p->state->underway = true;
+    }
+    if (underway) {
+      p->coalesced++;
+    }
+    else {
+      queueEvent(win, new BridgeEvent(p->eventType, new PosterPayload(p->state)));
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+  }
+
+  BridgeEvent* event = new BridgeEvent(p->eventType, NULL);
+  if (str) event->SetString(toWxString(str, len));
+  event->SetInt(i);
+  event->SetExtraLong(l);
+  queueEvent(win, event);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/**
+ * Returns the counters of a poster.
+ *
+ * @function poster:stats
+ * @treturn table `{ sent = ..., coalesced = ..., rejected = ... }`: values queued (including the coalesced ones), values that replaced pending ones, and values that were dropped or rejected.
+ */
+static int posterStats(lua_State* L) {
+  Poster* p = checkPoster(L);
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, p->sent);
+  lua_setfield(L, -2, "sent");
+  lua_pushinteger(L, p->coalesced);
+  lua_setfield(L, -2, "coalesced");
+  lua_pushinteger(L, p->rejected);
+  lua_setfield(L, -2, "rejected");
+  return 1;
+}
+
+static int posterGc(lua_State* L) {
+  Poster* p = (Poster*)luaL_checkudata(L, 1, POSTER);
+  if (p->state) p->state->release();
+  p->state = NULL;
+  return 0;
+}
+
+static const luaL_Reg poster_funcs[] = {
+  {"send", posterSend},
+  {"stats", posterStats},
+  {NULL, NULL}
+};
+
+// Common checks of the native operations. Returns the target pointer or handle
+// and the window behind it in win (NULL for a dead handle).
+static void* checkNative(lua_State* L, const char* fname, wxWindow*& win) {
+  win = checkTarget(L, fname);
+  if (!s_host) {
+    luaL_error(L, "wxLanesBridge: %s() needs the init() options host and native.", fname);
+  }
+  return lua_touserdata(L, 1);
+}
+
+/**
+ * Sets the value of a gauge from any thread, without a Lua handler.
+ *
+ * The update is carried out by C++ code in the GUI thread, through the host
+ * window passed to @{bridge.init}, so no Lua handler runs for it. Updates are
+ * coalesced per widget: if several values are set before the GUI thread gets
+ * to it, only the newest is applied.
+ *
+ * The pointer must refer to a window. Its class is checked by name in the GUI
+ * thread: an update of a window that is no wxGauge is skipped and counted as 
+ * dropped (see @{bridge.stats}).
+ *
+ * @function bridge.setGaugeValue
+ * @tparam lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of a wxGauge.
+ * @tparam integer value The new value.
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not an integer, or if the bridge has not been initialized with a host window.
+ * @usage
+ * -- In main GUI thread
+ * local bridge = require("wxLanesBridge").init(wx.wxEVT_THREAD,
+ *   { host = frame, native = wx.wxNewEventType() })
+ *
+ * -- In worker lane
+ * for n = 1, total do
+ *   bridge.setGaugeValue(gaugePtr, n)
+ * end
+ */
+static int setGaugeValue(lua_State* L) {
+  wxWindow* win;
+  void* target = checkNative(L, "setGaugeValue", win);
+  NativeOp op;
+  op.value = (int)luaL_checkinteger(L, 2);
+  if (!win) return 0; // dead handle
+  stats().posted(win, 1, 0);
+  postNative(NativeKey(target, NATIVE_GAUGE_VALUE, 0), op);
+  return 0;
+}
+
+/**
+ * Sets the label of a window (button, static text, frame title, ...) from any
+ * thread, without a Lua handler.
+ *
+ * Executed, coalesced and checked like @{bridge.setGaugeValue}: any window 
+ * will do.
+ *
+ * @function bridge.setLabel
+ * @tparam lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of the window.
+ * @tparam string label The new label (UTF-8).
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a string, or if the bridge has not been initialized with a host window.
+ * @usage
+ * bridge.setLabel(labelPtr, string.format("%d of %d files", n, total))
+ */
+static int setLabel(lua_State* L) {
+  wxWindow* win;
+  void* target = checkNative(L, "setLabel", win);
+  size_t len;
+  const char* str = luaL_checklstring(L, 2, &len);
+  if (!win) return 0; // dead handle
+  NativeOp op;
+  op.text.assign(str, len);
+  stats().posted(win, 1, len);
+  postNative(NativeKey(target, NATIVE_LABEL, 0), op);
+  return 0;
+}
+
+/**
+ * Sets a status bar field of a frame from any thread, without a Lua handler.
+ *
+ * Executed, coalesced (per frame and field) and checked like 
+ * @{bridge.setGaugeValue}: the window must be a wxFrame.
+ *
+ * @function bridge.setStatusText
+ * @tparam lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of a wxFrame with a status bar.
+ * @tparam string text The new status text (UTF-8).
+ * @tparam[opt=0] integer field The status bar field.
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a string, or if the bridge has not been initialized with a host window.
+ * @usage
+ * bridge.setStatusText(framePtr, "Connected", 1)
+ */
+static int setStatusText(lua_State* L) {
+  wxWindow* win;
+  void* target = checkNative(L, "setStatusText", win);
+  size_t len;
+  const char* str = luaL_checklstring(L, 2, &len);
+  int field = (int)luaL_optinteger(L, 3, 0);
+  if (!win) return 0; // dead handle
+  NativeOp op;
+  op.text.assign(str, len);
+  stats().posted(win, 1, len);
+  postNative(NativeKey(target, NATIVE_STATUS_TEXT, field), op);
+  return 0;
+}
+
+/**
+ * Configures the delivery of events to a target object.
+ *
+ * With a minimum interval set, events to the target are paced: records posted
+ * via @{bridge.postEvent}, @{bridge.postEventBatch} and @{bridge.postLatest} are
+ * collected by the bridge and delivered together with at most one event per 
+ * interval, e.g. once per frame at 60 Hz. This puts an upper bound on the number
+ * of handler calls and repaints in the GUI thread, regardless of how fast the 
+ * lanes post. Within one interval, @{bridge.postLatest} keeps only the newest 
+ * value per key.
+ *
+ * With a maximum queue length set, the records collected for the target are
+ * bounded. When the queue is full, the policy decides what happens to a new 
+ * record:
+ *
+ * - `"block"` (default): the posting lane waits until the GUI thread has taken
+ *   the queue, at most `timeout` milliseconds. If it is still full then, the 
+ *   record is rejected. Posts from the GUI thread itself never block and are 
+ *   rejected right away.
+ * - `"dropOldest"`: the oldest queued record is dropped to make room.
+ * - `"dropNewest"`: the new record is dropped.
+ * - `"fail"`: the new record is rejected.
+ *
+ * The posting functions report dropped and rejected records in their return 
+ * value, and @{bridge.stats} counts them as `dropped`. Replacing a value via 
+ * @{bridge.postLatest} never needs room.
+ *
+ * The handler of a configured target must read the collected records with 
+ * @{bridge.getBatch}; records not read by the handler are discarded.
+ *
+ * @function bridge.configure
+ * @tparam lightuserdata objPtr The pointer to the target wxLua object (see @{bridge.getPointer}).
+ * @tparam table options Delivery options:
+ * @tparam[opt=0] number options.interval Minimum interval between two events in milliseconds. 0 disables pacing.
+ * @tparam[opt=0] integer options.maxQueue Maximum number of records waiting for the GUI thread. 0 for no limit.
+ * @tparam[opt="block"] string options.policy What to do when the queue is full: `"block"`, `"dropOldest"`, `"dropNewest"` or `"fail"`.
+ * @tparam[opt] number options.timeout Maximum wait of the `"block"` policy in milliseconds. Waits indefinitely if omitted.
+ * @treturn nil Does nothing for a dead handle or once posts are closed (see @{bridge.flush}).
+ * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a table, an option is invalid, or if the bridge has not been initialized.
+ * @usage
+ * -- In main GUI thread: at most 60 updates per second for the plot panel
+ * bridge.configure(bridge.getPointer(plotPanel), { interval = 1000 / 60 })
+ *
+ * -- Keep at most 1000 samples; a lane that gets ahead waits up to 50 ms
+ * bridge.configure(bridge.getPointer(plotPanel), { maxQueue = 1000, timeout = 50 })
+ *
+ * -- Log window: never hold up the lanes, lose the oldest lines instead
+ * bridge.configure(bridge.getPointer(logCtrl), { maxQueue = 500, policy = "dropOldest" })
+ */
+static int configure(lua_State* L) {
+  wxWindow* win = checkTarget(L, "configure");
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_Number interval = optNumberField(L, 2, "interval", 0);
+  lua_Number maxQueue = optNumberField(L, 2, "maxQueue", 0);
+  lua_Number timeout = optNumberField(L, 2, "timeout", -1);
+  lua_getfield(L, 2, "policy");
+  int policy = luaL_checkoption(L, -1, "block", s_policyNames);
+  lua_pop(L, 1);
+  if (maxQueue < 0) {
+    return luaL_error(L, "wxLanesBridge: maxQueue must not be negative.");
+  }
+  if (!win) return 0; // dead handle or posts closed
+
+  std::lock_guard<std::mutex> lock(s_targetsMutex);
+  std::map<void*, Target*>::iterator it = s_targets.find(win);
+  if (interval > 0 || maxQueue > 0) {
+    if (interval > 0 && !s_pacer) s_pacer = new Pacer();
+    Target* target;
+    if (it == s_targets.end()) {
+      target = new Target(win);
+      s_targets[win] = target;
+      s_configuredTargets++;
+    }
+    else {
+      target = it->second;
+    }
+    {
+      std::lock_guard<std::mutex> targetLock(target->mutex);
+      target->interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(interval > 0 ? interval : 0));
+      target->maxQueue = (size_t)maxQueue;
+      target->policy = policy;
+      target->timeout = timeout < 0 ? -1 : (long)timeout;
+    }
+    // Lanes waiting for room re-check against the new limit
+    target->space.notify_all();
+  }
+  else if (it != s_targets.end()) {
+    // Unconfigured again. Records already collected are still delivered by the
+    // pending event, which holds its own reference to the target.
+    Target* target = it->second;
+    bool drained;
+    {
+      std::lock_guard<std::mutex> targetLock(target->mutex);
+      target->interval = Clock::duration::zero();
+      target->maxQueue = 0;
+      drained = target->drained;
+    }
+    target->space.notify_all();
+    if (drained) return 0; // stays registered until bridge.drain() ends
+    s_targets.erase(it);
+    s_configuredTargets--;
+    target->release();
+  }
+  return 0;
+}
+
+/**
+ * Hands the records posted to a GUI object to a callback at idle time, within
+ * a time budget.
+ *
+ * Normally every post results in an event, and the GUI thread handles queued 
+ * events one after the other until none is left: under heavy lane traffic,
+ * user input has to wait. A drained target collects the records posted to it
+ * instead (like a target configured via @{bridge.configure}, whose options 
+ * still apply, except for the interval). The idle handler of the host window
+ * passed to @{bridge.init} calls the callback for one record after the other,
+ * in posting order, until the budget is used up. It then returns to the event
+ * loop, which processes pending input before the next idle event continues.
+ *
+ * The callback receives the same record table as the entries of
+ * @{bridge.getBatch}. Errors in the callback are written to `stderr` and do not
+ * stop draining. Calling `drain()` without a callback ends draining; records 
+ * still collected are then delivered as a batch event (see @{bridge.getBatch}).
+ * Draining also ends when the window is destroyed, if `wx.wxEVT_DESTROY` was 
+ * passed to @{bridge.init}. To be called in the GUI thread.
+ *
+ * @function bridge.drain
+ * @tparam lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of the target.
+ * @tparam[opt] function callback Called with each record. Omit to end draining.
+ * @tparam[opt] table options Drain options:
+ * @tparam[opt=4] number options.budget Time in milliseconds the callback may use per idle event. At least one record is handled per idle event.
+ * @treturn nil
+ * @raise Throws an error if an argument is invalid, if not called in the GUI thread, or if the bridge has not been initialized with the options host, native and idle.
+ * @usage
+ * -- In main GUI thread
+ * local bridge = require("wxLanesBridge").init(wx.wxEVT_THREAD,
+ *   { host = frame, native = wx.wxNewEventType(), idle = wx.wxEVT_IDLE })
+ * bridge.drain(bridge.getPointer(listCtrl), function(rec)
+ *   listCtrl:InsertItem(listCtrl:GetItemCount(), rec.s)
+ * end, { budget = 4 })
+ *
+ * -- In worker lane
+ * bridge.postEvent(listPtr, { s = line })
+ */
+static int drain(lua_State* L) {
+  wxWindow* win = checkTarget(L, "drain");
+  bool enable = !lua_isnoneornil(L, 2);
+  if (enable) luaL_checktype(L, 2, LUA_TFUNCTION);
+  lua_Number budget = 4;
+  if (!lua_isnoneornil(L, 3)) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+    budget = optNumberField(L, 3, "budget", budget);
+  }
+  if (budget <= 0) {
+    return luaL_error(L, "wxLanesBridge: budget must be positive.");
+  }
+  if (!s_host || s_idleEventID == wxEVT_NULL) {
+    return luaL_error(L, "wxLanesBridge: drain() needs the init() options host, native and idle.");
+  }
+  if (std::this_thread::get_id() != s_guiThread) {
+    return luaL_error(L, "wxLanesBridge: drain() must be called in the GUI thread.");
+  }
+  if (!win) return 0; // dead handle
+  int callback = LUA_NOREF;
+  if (enable) {
+    lua_pushvalue(L, 2);
+    callback = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  int previous = LUA_NOREF;
+  {
+    std::lock_guard<std::mutex> lock(s_targetsMutex);
+    std::map<void*, Target*>::iterator it = s_targets.find(win);
+    Target* target = it != s_targets.end() ? it->second : NULL;
+    if (target && target->callback != LUA_NOREF) {
+      if (enable) {
+        // Replace the callback
+        previous = target->callback;
+        target->callback = callback;
+      }
+      else {
+        previous = undrain(target);
+        bool configured;
+        {
+          std::lock_guard<std::mutex> targetLock(target->mutex);
+          configured = target->maxQueue > 0 || target->interval > Clock::duration::zero();
+        }
+        if (!configured) {
+          s_targets.erase(it);
+          s_configuredTargets--;
+          target->release();
+        }
+      }
+    }
+    else if (enable) {
+      if (!target) {
+        target = new Target(win);
+        s_targets[win] = target;
+        s_configuredTargets++;
+      }
+      target->callback = callback;
+      target->addRef(); // of s_drained
+      s_drained.push_back(target);
+      bool wakeUp;
+      {
+        std::lock_guard<std::mutex> targetLock(target->mutex);
+        target->drained = true;
+        // Records collected before are drained as well
+        wakeUp = !target->scheduled && !target->queue.empty();
+        if (wakeUp) target->scheduled = true;
+      }
+      if (wakeUp) postWakeUp();
+    }
+    if (target) {
+      target->budget = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(budget));
+    }
+  }
+  if (previous != LUA_NOREF) luaL_unref(L, LUA_REGISTRYINDEX, previous);
+  return 0;
+}
+
+/**
+ * Creates a lock-free ring buffer for sending records to a GUI object.
+ *
+ * The ring has a fixed capacity and may be filled by any number of lanes at 
+ * the same time via @{bridge.ringPush}. Pushing records takes neither locks nor
+ * heap allocations for short strings. A single doorbell event is posted to the 
+ * target only when the ring goes from empty to non-empty; the GUI thread then 
+ * drains all queued records at once with @{bridge.getBatch}.
+ *
+ * The returned handle is lightuserdata and can be passed to lanes. Once the 
+ * ring is closed (see @{bridge.ringClose}), the handle is dead and pushing 
+ * fails, so lanes may keep it safely.
+ *
+ * @function bridge.ring
+ * @tparam lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of the target object. With a handle, no doorbell is posted once the window is destroyed.
+ * @tparam[opt=1024] integer capacity Maximum number of queued records (rounded up to a power of 2).
+ * @tparam[opt] integer|string channel Channel id or name (see @{bridge.registerChannel}) selecting the event type. Defaults to the type of @{bridge.init}.
+ * @treturn lightuserdata|nil Handle of the ring, nil for a dead handle or once posts are closed (see @{bridge.flush}).
+ * @raise Throws an error if Argument 1 is not lightuserdata, if the bridge has not been initialized or if too many rings are open.
+ * @usage
+ * -- In main GUI thread
+ * local ring = bridge.ring(bridge.getPointer(frame), 4096)
+ * frame:Connect(wx.wxEVT_THREAD, function(event)
+ *   for _, rec in ipairs(bridge.getBatch(event)) do
+ *     -- ...
+ *   end
+ * end)
+ *
+ * -- In worker lane
+ * bridge.ringPush(ring, { s = "sample", i = 42 })
+ */
+static int ring(lua_State* L) {
+  wxWindow* win = checkTarget(L, "ring");
+  lua_Integer capacity = luaL_optinteger(L, 2, 1024);
+  luaL_argcheck(L, capacity > 0 && capacity <= (1 << 24), 2, "capacity out of range");
+  wxEventType eventType = optChannel(L, 3);
+  if (!win) return 0; // dead handle or posts closed
+  Ring* r = new Ring(lua_touserdata(L, 1), (size_t)capacity, eventType);
+  void* h = objects().add(r, OBJECT_RING);
+  if (!h) {
+    r->release();
+    return luaL_error(L, "wxLanesBridge: Too many rings.");
+  }
+  lua_pushlightuserdata(L, h);
+  return 1;
+}
+
+/**
+ * Pushes one record into a ring buffer.
+ *
+ * Rings the doorbell of the ring's target object if this is the first record 
+ * since the GUI thread last drained the ring.
+ *
+ * @function bridge.ringPush
+ * @tparam lightuserdata ring The ring handle (see @{bridge.ring}).
+ * @tparam[opt] table data Optional data table with the fields `s`, `i` and `l` as in @{bridge.postEvent}.
+ * @treturn boolean `true` on success, `false` if the ring is full or has been closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ * @usage
+ * if not bridge.ringPush(ring, { i = progress }) then
+ *   -- ring full, GUI thread is lagging behind
+ * end
+ */
+static int ringPush(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  // A reference, as reading the data table may raise Lua errors
+  Ref<Ring> r(acquire<Ring>(lua_touserdata(L, 1), OBJECT_RING));
+  if (!r.get()) {
+    lua_pushboolean(L, 0); // closed
+    return 1;
+  }
+  size_t size = 0;
+  bool ok = r->push(L, 2, size);
+  if (ok) stats().posted(resolveTarget(r->GetTarget()), 1, size);
+  if (ok && !r->doorbell.exchange(true)) {
+    // Ring went from empty to non-empty: ring the doorbell, unless the target
+    // is gone (dead handle) or posts are closed
+    TargetUse use(r->GetTarget());
+    if (use.get()) queueEvent(use.get(), new BridgeEvent(r->GetEventType(), new RingDoorbell(r.get())));
+    else r->doorbell.store(false);
+  }
+  lua_pushboolean(L, ok);
+  return 1;
+}
+
+/**
+ * Closes a ring buffer.
+ *
+ * Kills the handle returned by @{bridge.ring}. Records still queued are 
+ * delivered with doorbell events already under way; the ring memory is freed 
+ * once the last of those events has been handled. From then on, 
+ * @{bridge.ringPush} returns false for the handle. Closing it again does 
+ * nothing.
+ *
+ * @function bridge.ringClose
+ * @tparam lightuserdata ring The ring handle (see @{bridge.ring}).
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ */
+static int ringClose(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  Ring* r = removeObject<Ring>(lua_touserdata(L, 1), OBJECT_RING);
+  if (r) r->release();
+  return 0;
+}
+
+/**
+ * Creates a log sink for a wxTextCtrl.
+ *
+ * Lanes write lines into the sink via @{bridge.logLine}, which only appends 
+ * them to a buffer. The bridge flushes all lines collected until the GUI thread
+ * gets to it with a single `AppendText()` through the host window passed to 
+ * @{bridge.init}, so no Lua handler runs for it. With an interval, this 
+ * happens at most once per interval (e.g. per frame), unless the pending text
+ * reaches the threshold. With a line limit, the oldest lines of the control are 
+ * removed after appending, and lines that would be removed right away are 
+ * never transferred.
+ *
+ * The pointer must refer to a window. If it is no wxTextCtrl (checked by class
+ * name in the GUI thread), the text is discarded.
+ *
+ * The returned handle is lightuserdata and can be passed to lanes. Once the 
+ * sink is closed (see @{bridge.logClose}), the handle is dead and lines written
+ * into it are discarded, so lanes may keep it safely.
+ *
+ * @function bridge.logSink
+ * @tparam lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of a wxTextCtrl.
+ * @tparam[opt] table options Sink options:
+ * @tparam[opt=0] integer options.maxLines Maximum number of lines kept in the control. 0 for no limit.
+ * @tparam[opt=0] number options.interval Minimum interval between two flushes in milliseconds.
+ * @tparam[opt=0] integer options.threshold Pending text size in bytes that is flushed without waiting for the interval. 0 for none.
+ * @treturn lightuserdata|nil Handle of the sink, nil for a dead handle or once posts are closed (see @{bridge.flush}).
+ * @raise Throws an error if Argument 1 is not lightuserdata, an option is invalid, if the bridge has not been initialized with a host window or if too many sinks are open.
+ * @usage
+ * -- In main GUI thread
+ * local bridge = require("wxLanesBridge").init(wx.wxEVT_THREAD,
+ *   { host = frame, native = wx.wxNewEventType() })
+ * local log = bridge.logSink(bridge.getPointer(logCtrl), { maxLines = 5000, interval = 1000 / 60 })
+ *
+ * -- In worker lane
+ * bridge.logLine(log, string.format("step %d done", n))
+ */
+static int logSink(lua_State* L) {
+  wxWindow* win;
+  void* target = checkNative(L, "logSink", win);
+  lua_Number maxLines = 0;
+  lua_Number interval = 0;
+  lua_Number threshold = 0;
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    maxLines = optNumberField(L, 2, "maxLines", 0);
+    interval = optNumberField(L, 2, "interval", 0);
+    threshold = optNumberField(L, 2, "threshold", 0);
+  }
+  if (maxLines < 0 || interval < 0 || threshold < 0) {
+    return luaL_error(L, "wxLanesBridge: logSink() options must not be negative.");
+  }
+  if (!win) return 0; // dead handle or posts closed
+  if (interval > 0) {
+    std::lock_guard<std::mutex> lock(s_targetsMutex);
+    if (!s_pacer) s_pacer = new Pacer();
+  }
+  LogSink* sink = new LogSink(target, (size_t)maxLines,
+    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(interval)),
+    (size_t)threshold);
+  void* h = objects().add(sink, OBJECT_LOG);
+  if (!h) {
+    sink->release();
+    return luaL_error(L, "wxLanesBridge: Too many log sinks.");
+  }
+  lua_pushlightuserdata(L, h);
+  return 1;
+}
 
 /**
- * Initializes the wxLanesBridge module by setting the process-wide 
- * `wxThreadEvent` ID. 
- * 
- * This is a necessary requirement when both the wxLua and
- * wxLanesBridge DLLs are linked against a static version of the wxWidgets library.
- * In this configuration, each DLL maintains its own static wxWidgets instance.
- * 
- * Since wxWidgets' internal event IDs (declared via `wxDECLARE_EVENT()` and 
- * `wxDEFINE_EVENT()`) are generated dynamically at runtime using `wxNewEventType()`,
- * the integer values for constants like `wxEVT_THREAD` may differ between the two 
- * DLLs depending on the order of initialization.
+ * Writes a line into a log sink.
+ *
+ * Appends the text and a newline to the pending text of the sink and schedules 
+ * a flush if none is under way. Takes a lock for the copy only. Does nothing
+ * once the sink has been closed.
+ *
+ * @function bridge.logLine
+ * @tparam lightuserdata sink The sink handle (see @{bridge.logSink}).
+ * @tparam string text The line, without newline.
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata or Argument 2 is not a string.
+ * @usage
+ * bridge.logLine(log, "connected to " .. host)
+ */
+static int logLine(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  size_t len;
+  const char* text = luaL_checklstring(L, 2, &len);
+  ObjectUse<LogSink> use(lua_touserdata(L, 1), OBJECT_LOG);
+  if (use.get()) use.get()->write(text, len);
+  return 0;
+}
+
+/**
+ * Closes a log sink.
+ *
+ * Kills the handle returned by @{bridge.logSink}. Text still pending is
+ * flushed. From then on, @{bridge.logLine} discards lines written into the 
+ * handle. Closing it again does nothing.
+ *
+ * @function bridge.logClose
+ * @tparam lightuserdata sink The sink handle (see @{bridge.logSink}).
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ */
+static int logClose(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  LogSink* sink = removeObject<LogSink>(lua_touserdata(L, 1), OBJECT_LOG);
+  if (sink) sink->release();
+  return 0;
+}
+
+/**
+ * Creates a shared numeric array, e.g. for live plot data.
+ *
+ * The array consists of three buffers of `n` elements. One lane fills the back
+ * buffer in place via @{bridge.arraySet} (or through the pointer of 
+ * @{bridge.arrayBack}) and publishes it via @{bridge.arrayPublish}, which 
+ * swaps buffers without locking and without copying. The GUI thread takes the
+ * newest published buffer via @{bridge.arrayFront} and reads it directly, 
+ * e.g. by passing its pointer to a plotting library, or via @{bridge.arrayGet}.
+ * Versions published faster than the GUI thread takes them are skipped.
+ *
+ * With a target object, publishing posts a doorbell event to it if none is 
+ * under way. Its `GetInt()` is the sequence number of the published version.
+ *
+ * The returned handle is lightuserdata and can be passed to lanes. Only one lane
+ * may write to the array. Once the array is closed (see @{bridge.arrayClose}),
+ * the handle is dead and the array functions raise an error for it.
+ *
+ * @function bridge.sharedArray
+ * @tparam integer n Number of elements.
+ * @tparam[opt="double"] string type Element type: `"double"`, `"float"` or `"int32"`.
+ * @tparam[opt] lightuserdata objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of the object receiving doorbell events.
+ * @tparam[opt] integer|string channel Channel id or name (see @{bridge.registerChannel}) selecting the event type of the doorbell events. Defaults to the type of @{bridge.init}.
+ * @treturn lightuserdata|nil Handle of the array, nil if the target is a dead handle or posts are closed (see @{bridge.flush}).
+ * @raise Throws an error if an argument is invalid, if a target is given and the bridge has not been initialized, or if too many arrays are open.
+ * @usage
+ * -- In main GUI thread
+ * local samples = bridge.sharedArray(100000, "double", bridge.getPointer(plotPanel))
+ * plotPanel:Connect(wx.wxEVT_THREAD, function(event)
+ *   local ptr, seq, n = bridge.arrayFront(samples)
+ *   plot.draw(ptr, n) -- e.g. a C plotting binding reading the doubles in place
+ * end)
+ *
+ * -- In worker lane
+ * for k = 1, 100000 do bridge.arraySet(samples, k, math.sin(k * phase)) end
+ * bridge.arrayPublish(samples)
+ */
+static int sharedArray(lua_State* L) {
+  lua_Integer size = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, size > 0 && size <= (1 << 28), 1, "size out of range");
+  int type = luaL_checkoption(L, 2, "double", s_arrayTypeNames);
+  void* target = NULL;
+  wxEventType eventType = s_defaultEventID;
+  if (!lua_isnoneornil(L, 3)) {
+    if (s_defaultEventID.load(std::memory_order_acquire) == wxID_ANY) {
+      return luaL_error(L, "wxLanesBridge: Error - Call init() before sharedArray().");
+    }
+    luaL_checktype(L, 3, LUA_TLIGHTUSERDATA);
+    target = lua_touserdata(L, 3);
+    eventType = optChannel(L, 4);
+    if (s_closed.load() || !resolveTarget(target)) return 0; // dead handle or posts closed
+  }
+  SharedArray* array = new SharedArray((size_t)size, type, target, eventType);
+  void* h = objects().add(array, OBJECT_ARRAY);
+  if (!h) {
+    array->release();
+    return luaL_error(L, "wxLanesBridge: Too many shared arrays.");
+  }
+  lua_pushlightuserdata(L, h);
+  return 1;
+}
+
+// Refers to the shared array behind the handle at idx. Raises a Lua error if
+// it is no live array handle, so it is to be called after the argument checks
+// that do not need the array.
+static void checkArray(lua_State* L, int idx, Ref<SharedArray>& array) {
+  luaL_checktype(L, idx, LUA_TLIGHTUSERDATA);
+  SharedArray* ptr = acquire<SharedArray>(lua_touserdata(L, idx), OBJECT_ARRAY);
+  if (!ptr) luaL_argerror(L, idx, "shared array is closed or no shared array");
+  Ref<SharedArray>(ptr).swap(array);
+}
+
+// Returns whether count elements starting at the 1-based index are within the
+// array
+static bool inArray(SharedArray* array, lua_Integer index, lua_Integer count) {
+  return index >= 1 && count >= 0 && (lua_Unsigned)(index - 1 + count) <= array->size();
+}
+
+/**
+ * Sets elements of the back buffer of a shared array.
+ *
+ * Sets consecutive elements starting at `index`, either to the values given as
+ * further arguments or to the entries of a table (a sequence). After 
+ * @{bridge.arrayPublish}, the back buffer holds an older version, so each 
+ * update should write all elements it needs. To be called by the writing lane.
+ *
+ * @function bridge.arraySet
+ * @tparam lightuserdata array The array handle (see @{bridge.sharedArray}).
+ * @tparam integer index 1-based index of the first element.
+ * @tparam number|table ... The values, or a table of values.
+ * @treturn nil
+ * @raise Throws an error if an argument is invalid or the elements are out of range.
+ * @usage
+ * bridge.arraySet(samples, 1, x, y, z)
+ * bridge.arraySet(samples, 4, { 1.5, 2.5, 3.5 })
+ */
+static int arraySet(lua_State* L) {
+  lua_Integer index = luaL_checkinteger(L, 2);
+  bool table = lua_istable(L, 3);
+  lua_Integer count = table ? (lua_Integer)lua_rawlen(L, 3) : lua_gettop(L) - 2;
+  Ref<SharedArray> array;
+  checkArray(L, 1, array);
+  // Errors are raised after dropping the reference
+  if (!inArray(array.get(), index, count)) {
+    array.reset();
+    return luaL_argerror(L, 2, "index out of range");
+  }
+  size_t first = (size_t)(index - 1);
+  void* data = array->back();
+  for (lua_Integer k = 0; k < count; k++) {
+    int isNumber;
+    lua_Number v;
+    if (table) {
+      lua_rawgeti(L, 3, k + 1);
+      v = lua_tonumberx(L, -1, &isNumber);
+      lua_pop(L, 1);
+    }
+    else {
+      v = lua_tonumberx(L, 3 + (int)k, &isNumber);
+    }
+    if (!isNumber) {
+      array.reset();
+      if (table) return luaL_error(L, "wxLanesBridge: Entry %d of the table must be a number.", (int)k + 1);
+      return luaL_checknumber(L, 3 + (int)k); // raises
+    }
+    size_t n = first + (size_t)k;
+    switch (array->type()) {
+      case ARRAY_DOUBLE: ((double*)data)[n] = (double)v; break;
+      case ARRAY_FLOAT: ((float*)data)[n] = (float)v; break;
+      default: ((int32_t*)data)[n] = (int32_t)v; break;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Returns the back buffer of a shared array, for filling it from C code.
+ *
+ * The pointer changes with every @{bridge.arrayPublish}. To be called by the
+ * writing lane.
+ *
+ * @function bridge.arrayBack
+ * @tparam lightuserdata array The array handle (see @{bridge.sharedArray}).
+ * @treturn lightuserdata Pointer to the first element.
+ * @treturn integer Number of elements.
+ * @raise Throws an error if Argument 1 is no live array handle.
+ */
+static int arrayBack(lua_State* L) {
+  Ref<SharedArray> array;
+  checkArray(L, 1, array);
+  lua_pushlightuserdata(L, array->back());
+  lua_pushinteger(L, (lua_Integer)array->size());
+  return 2;
+}
+
+/**
+ * Publishes the back buffer of a shared array.
+ *
+ * Makes the data written since the last call the newest version, and rings 
+ * the doorbell of the array's target object if none is under way. To be 
+ * called by the writing lane.
+ *
+ * @function bridge.arrayPublish
+ * @tparam lightuserdata array The array handle (see @{bridge.sharedArray}).
+ * @treturn integer Sequence number of the published version, counting from 1.
+ * @raise Throws an error if Argument 1 is no live array handle.
+ */
+static int arrayPublish(lua_State* L) {
+  Ref<SharedArray> array;
+  checkArray(L, 1, array);
+  unsigned long long seq = array->publish();
+  if (array->target() && !array->doorbell.exchange(true)) {
+    TargetUse use(array->target());
+    if (use.get()) {
+      stats().posted(use.get(), 1, array->size() * s_arrayTypeSizes[array->type()]);
+      BridgeEvent* event = new BridgeEvent(array->GetEventType(), new ArrayDoorbell(array.get()));
+      event->SetInt((int)seq);
+      queueEvent(use.get(), event);
+    }
+    else {
+      array->doorbell.store(false); // dead handle
+    }
+  }
+  lua_pushinteger(L, (lua_Integer)seq);
+  return 1;
+}
+
+/**
+ * Takes the newest published version of a shared array.
+ *
+ * The returned pointer stays valid, and the data unchanged, until the next 
+ * call of this function. To be called in the GUI thread.
+ *
+ * @function bridge.arrayFront
+ * @tparam lightuserdata array The array handle (see @{bridge.sharedArray}).
+ * @treturn lightuserdata Pointer to the first element of the front buffer.
+ * @treturn integer Sequence number of its version, 0 if nothing was published yet.
+ * @treturn integer Number of elements.
+ * @raise Throws an error if Argument 1 is no live array handle.
+ */
+static int arrayFront(lua_State* L) {
+  Ref<SharedArray> array;
+  checkArray(L, 1, array);
+  unsigned long long seq;
+  lua_pushlightuserdata(L, array->take(seq));
+  lua_pushinteger(L, (lua_Integer)seq);
+  lua_pushinteger(L, (lua_Integer)array->size());
+  return 3;
+}
+
+/**
+ * Reads elements of the front buffer of a shared array.
+ *
+ * Reads from the version taken by the last @{bridge.arrayFront}. Meant for 
+ * small parts of the array; large arrays are best read through the pointer. 
+ * To be called in the GUI thread.
+ *
+ * @function bridge.arrayGet
+ * @tparam lightuserdata array The array handle (see @{bridge.sharedArray}).
+ * @tparam integer index 1-based index of the first element.
+ * @tparam[opt=1] integer count Number of elements.
+ * @treturn number ... The values.
+ * @raise Throws an error if an argument is invalid or the elements are out of range.
+ * @usage
+ * local last = bridge.arrayGet(samples, n)
+ */
+static int arrayGet(lua_State* L) {
+  lua_Integer index = luaL_checkinteger(L, 2);
+  lua_Integer count = luaL_optinteger(L, 3, 1);
+  Ref<SharedArray> array;
+  checkArray(L, 1, array);
+  // Errors are raised after dropping the reference
+  if (!inArray(array.get(), index, count)) {
+    array.reset();
+    return luaL_argerror(L, 2, "index out of range");
+  }
+  if (!lua_checkstack(L, (int)count)) {
+    array.reset();
+    return luaL_error(L, "stack overflow (too many elements)");
+  }
+  size_t first = (size_t)(index - 1);
+  const void* data = array->front();
+  for (lua_Integer k = 0; k < count; k++) {
+    size_t n = first + (size_t)k;
+    switch (array->type()) {
+      case ARRAY_DOUBLE: lua_pushnumber(L, ((const double*)data)[n]); break;
+      case ARRAY_FLOAT: lua_pushnumber(L, ((const float*)data)[n]); break;
+      default: lua_pushinteger(L, ((const int32_t*)data)[n]); break;
+    }
+  }
+  return (int)count;
+}
+
+/**
+ * Closes a shared array.
+ *
+ * Kills the handle returned by @{bridge.sharedArray}. The memory is freed once
+ * a doorbell event under way has been handled, so the buffer pointers must not
+ * be used afterwards. From then on, the array functions raise an error for the
+ * handle. Closing it again does nothing.
+ *
+ * @function bridge.arrayClose
+ * @tparam lightuserdata array The array handle (see @{bridge.sharedArray}).
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ */
+static int arrayClose(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  SharedArray* array = removeObject<SharedArray>(lua_touserdata(L, 1), OBJECT_ARRAY);
+  if (array) array->release();
+  return 0;
+}
+
+/**
+ * Creates a pool of worker threads for short jobs.
+ *
+ * Starting a lane for each short job costs a fresh Lua state and loading its 
+ * libraries. The pool starts its threads once, each with its own Lua state 
+ * with the standard libraries opened and the optional init chunk run (e.g. to
+ * `require` the modules the jobs need). Jobs are submitted via 
+ * @{bridge.submit}; idle workers take over queued jobs of busy ones, so all 
+ * cores stay in use for many small tasks.
+ *
+ * The returned handle is lightuserdata. Close the pool via 
+ * @{bridge.workersClose} when it is no longer needed.
+ *
+ * @function bridge.workers
+ * @tparam[opt] integer count Number of threads. Defaults to the number of cores.
+ * @tparam[opt] table options Pool options:
+ * @tparam[opt] string options.init Lua source run once in each worker state.
+ * @treturn lightuserdata Handle of the pool.
+ * @raise Throws an error if an argument is invalid or if too many pools are open.
+ * @usage
+ * local pool = bridge.workers(nil, { init = "json = require('dkjson')" })
+ */
+static int workers(lua_State* L) {
+  lua_Integer count = luaL_optinteger(L, 1, (lua_Integer)std::thread::hardware_concurrency());
+  if (count < 1) count = 1;
+  luaL_argcheck(L, count <= 256, 1, "too many workers");
+  std::string init;
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "init");
+    if (!lua_isnil(L, -1)) {
+      size_t len;
+      const char* str = lua_tolstring(L, -1, &len);
+      if (!str) return luaL_error(L, "wxLanesBridge: Option 'init' must be a string.");
+      init.assign(str, len);
+    }
+    lua_pop(L, 1);
+  }
+  WorkerPool* pool = new WorkerPool((size_t)count, init);
+  void* h = objects().add(pool, OBJECT_WORKERS);
+  if (!h) {
+    pool->close();
+    pool->release();
+    return luaL_error(L, "wxLanesBridge: Too many worker pools.");
+  }
+  lua_pushlightuserdata(L, h);
+  return 1;
+}
+
+// lua_Writer of lua_dump(), appending to a std::string
+static int dumpWriter(lua_State*, const void* p, size_t size, void* ud) {
+  ((std::string*)ud)->append((const char*)p, size);
+  return 0;
+}
+
+/**
+ * Submits a job to a worker pool.
+ *
+ * The job is a Lua function, or Lua source code, run with the given arguments
+ * in one of the pool's Lua states. A function is transferred as bytecode, so 
+ * it must not have upvalues other than `_ENV` (globals refer to the worker 
+ * state). Arguments and results are packed as with @{bridge.pack}.
+ *
+ * When the job has finished, an event is posted to the target. Its `GetInt()`
+ * is the job id and `GetExtraLong()` is 1 if the job succeeded. The results 
+ * are then read with @{bridge.unpack} as a table with field `n`; otherwise
+ * `GetString()` is the error message. Jobs may finish in any order.
+ *
+ * @function bridge.submit
+ * @tparam lightuserdata pool The pool handle (see @{bridge.workers}).
+ * @tparam lightuserdata|nil objPtr Pointer (see @{bridge.getPointer}) or handle (see @{bridge.handle}) of the object receiving the result event, or nil to discard the results.
+ * @tparam function|string job The function or source code.
+ * @param ... Arguments of the job.
+ * @treturn integer|nil Id of the job, nil if the pool has been closed.
+ * @raise Throws an error if an argument is invalid or cannot be packed, or if a target is given and the bridge has not been initialized.
+ * @usage
+ * -- In main GUI thread
+ * frame:Connect(wx.wxEVT_THREAD, function(event)
+ *   if event:GetExtraLong() == 1 then
+ *     local results = bridge.unpack(event)
+ *     print("job", event:GetInt(), "returned", results[1])
+ *   end
+ * end)
+ * for _, file in ipairs(files) do
+ *   bridge.submit(pool, framePtr, function(name)
+ *     local f = assert(io.open(name, "rb"))
+ *     local size = #f:read("a")
+ *     f:close()
+ *     return size
+ *   end, file)
+ * end
+ */
+static int submit(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  Job job;
+  if (!lua_isnil(L, 2)) {
+    if (s_defaultEventID.load(std::memory_order_acquire) == wxID_ANY) {
+      return luaL_error(L, "wxLanesBridge: Error - Call init() before submit().");
+    }
+    luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+    job.target = lua_touserdata(L, 2);
+    job.eventType = s_defaultEventID.load(std::memory_order_relaxed);
+  }
+  if (lua_type(L, 3) == LUA_TSTRING) {
+    size_t len;
+    const char* code = lua_tolstring(L, 3, &len);
+    job.code.assign(code, len);
+  }
+  else {
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    if (lua_iscfunction(L, 3)) {
+      return luaL_argerror(L, 3, "C functions cannot be submitted");
+    }
+    const char* name;
+    for (int n = 1; (name = lua_getupvalue(L, 3, n)) != NULL; n++) {
+      lua_pop(L, 1);
+      if (strcmp(name, "_ENV") != 0) {
+        return luaL_error(L, "wxLanesBridge: Job functions must not have upvalues (found '%s').", name);
+      }
+    }
+    lua_pushvalue(L, 3);
+    lua_dump(L, dumpWriter, &job.code, 0);
+    lua_pop(L, 1);
+  }
+  int nargs = lua_gettop(L) - 3;
+  lua_createtable(L, nargs, 1);
+  for (int n = 1; n <= nargs; n++) {
+    lua_pushvalue(L, 3 + n);
+    lua_rawseti(L, -2, n);
+  }
+  lua_pushinteger(L, nargs);
+  lua_setfield(L, -2, "n");
+  packValue(L, lua_gettop(L), job.args);
+  // Resolved last, as the checks above may raise Lua errors
+  ObjectUse<WorkerPool> use(lua_touserdata(L, 1), OBJECT_WORKERS);
+  WorkerPool* pool = use.get();
+  if (!pool) return 0; // closed
+  job.id = pool->nextId();
+  pool->submit(job);
+  lua_pushinteger(L, job.id);
+  return 1;
+}
+
+/**
+ * Closes a worker pool.
+ *
+ * Kills the handle returned by @{bridge.workers}. Jobs already submitted are 
+ * still run. The threads end when they are done. From then on, 
+ * @{bridge.submit} returns nil for the handle. Closing it again does nothing.
+ *
+ * @function bridge.workersClose
+ * @tparam lightuserdata pool The pool handle (see @{bridge.workers}).
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ */
+static int workersClose(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  WorkerPool* pool = removeObject<WorkerPool>(lua_touserdata(L, 1), OBJECT_WORKERS);
+  if (!pool) return 0; // closed before
+  pool->close();
+  pool->release();
+  return 0;
+}
+
+/**
+ * Creates a future: the result of a job that a lane completes later.
+ *
+ * The lane fulfils the future via @{bridge.fulfil} (or @{bridge.fail}). In
+ * the GUI thread, a callback attached via @{bridge.onComplete} is then called 
+ * with the value, or a coroutine waiting in @{bridge.await} is resumed with it. 
+ * This replaces a manual @{bridge.postEvent} per job and the bookkeeping of 
+ * which event belongs to which job. All completions arriving until the GUI 
+ * thread gets to them are delivered in one batch, with a single event through
+ * the host window passed to @{bridge.init}.
+ *
+ * The returned handle is lightuserdata and can be passed to a lane. Each 
+ * future must be completed (only the first completion counts) and be consumed
+ * by a callback or `await()`; it is freed after both have happened. Once it 
+ * has been consumed, the handle is dead. To be called in the GUI thread.
+ *
+ * @function bridge.future
+ * @treturn lightuserdata Handle of the future.
+ * @raise Throws an error if not called in the GUI thread, if the bridge has not been initialized with the options host and native, or if too many futures are open.
+ * @usage
+ * -- In main GUI thread: await a result in a coroutine
+ * coroutine.wrap(function()
+ *   local fut = bridge.future()
+ *   lanes.gen("*", worker)(fut, params)
+ *   local result, err = bridge.await(fut)
+ *   resultCtrl:SetValue(err or result.text)
+ * end)()
+ *
+ * -- In worker lane
+ * bridge.fulfil(fut, { text = compute(params) })
+ */
+static int future(lua_State* L) {
+  if (!s_host || s_guiState == NULL) {
+    return luaL_error(L, "wxLanesBridge: future() needs the init() options host and native.");
+  }
+  if (std::this_thread::get_id() != s_guiThread) {
+    return luaL_error(L, "wxLanesBridge: future() must be called in the GUI thread.");
+  }
+  Future* future = new Future();
+  future->handle = objects().add(future, OBJECT_FUTURE);
+  if (!future->handle) {
+    future->release();
+    future->release();
+    return luaL_error(L, "wxLanesBridge: Too many futures.");
+  }
+  lua_pushlightuserdata(L, future->handle);
+  return 1;
+}
+
+/**
+ * Fulfils a future with a value.
+ *
+ * The value is packed as with @{bridge.pack}. Can be called in any thread.
+ * Only the first completion counts: further calls of this function or 
+ * @{bridge.fail} return false and change nothing. Once the future has been 
+ * consumed, its handle is dead and they return false as well.
+ *
+ * @function bridge.fulfil
+ * @tparam lightuserdata future The future handle (see @{bridge.future}).
+ * @param value The result.
+ * @treturn boolean `true` if the future was completed, `false` if it already was or has been consumed.
+ * @raise Throws an error if Argument 1 is not lightuserdata or the value cannot be packed.
+ */
+static int fulfil(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  lua_settop(L, 2);
+  const std::string& value = packScratch(L, 2);
+  // Resolved last, as packing may raise Lua errors
+  ObjectUse<Future> use(lua_touserdata(L, 1), OBJECT_FUTURE);
+  Future* future = use.get();
+  bool first = future && !future->completed.exchange(true);
+  if (first) {
+    future->value = value;
+    future->ok = true;
+    completeFuture(future);
+  }
+  lua_pushboolean(L, first);
+  return 1;
+}
+
+/**
+ * Completes a future with an error.
+ *
+ * The GUI side then receives `nil` and the message. Can be called in any
+ * thread. Only the first completion counts (see @{bridge.fulfil}).
+ *
+ * @function bridge.fail
+ * @tparam lightuserdata future The future handle (see @{bridge.future}).
+ * @tparam string message The error message.
+ * @treturn boolean `true` if the future was completed, `false` if it already was or has been consumed.
+ * @raise Throws an error if Argument 1 is not lightuserdata or Argument 2 is not a string.
+ */
+static int fail(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  size_t len;
+  const char* message = luaL_checklstring(L, 2, &len);
+  ObjectUse<Future> use(lua_touserdata(L, 1), OBJECT_FUTURE);
+  Future* future = use.get();
+  bool first = future && !future->completed.exchange(true);
+  if (first) {
+    future->error.assign(message, len);
+    future->ok = false;
+    completeFuture(future);
+  }
+  lua_pushboolean(L, first);
+  return 1;
+}
+
+// Checks a future of the GUI side that has not been consumed yet. As only the 
+// GUI thread kills future handles, the future stays valid until it does.
+static Future* checkPendingFuture(lua_State* L, const char* fname) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  if (std::this_thread::get_id() != s_guiThread) {
+    luaL_error(L, "wxLanesBridge: %s() must be called in the GUI thread.", fname);
+  }
+  Future* future = ObjectUse<Future>(lua_touserdata(L, 1), OBJECT_FUTURE).get();
+  if (!future) luaL_argerror(L, 1, "future is consumed or no future");
+  if (future->callback != LUA_NOREF) {
+    luaL_error(L, "wxLanesBridge: The future is already being waited for.");
+  }
+  return future;
+}
+
+/**
+ * Attaches a callback to a future.
+ *
+ * The callback is called in the GUI thread with the value, or with `nil` and
+ * the error message, when the future is completed. If it already is, the 
+ * callback is called right away. Errors in the callback are written to `stderr`.
+ *
+ * @function bridge.onComplete
+ * @tparam lightuserdata future The future handle (see @{bridge.future}).
+ * @tparam function callback Called with `(value)` or `(nil, message)`.
+ * @treturn nil
+ * @raise Throws an error if an argument is invalid, if not called in the GUI thread, or if the future already has a callback or waiting coroutine or has been consumed.
+ * @usage
+ * local fut = bridge.future()
+ * bridge.onComplete(fut, function(result, err)
+ *   statusBar:SetStatusText(err or ("done: " .. result))
+ * end)
+ */
+static int onComplete(lua_State* L) {
+  Future* future = checkPendingFuture(L, "onComplete");
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  lua_pushvalue(L, 2);
+  setCallback(L, future);
+  if (future->done) consumeFuture(L, future);
+  return 0;
+}
+
+/**
+ * Waits for a future in a coroutine.
+ *
+ * Suspends the calling coroutine of the GUI thread until the future is 
+ * completed, then returns the value, or `nil` and the error message. Returns 
+ * right away if the future already is completed. The event loop keeps running
+ * while the coroutine is suspended.
+ *
+ * @function bridge.await
+ * @tparam lightuserdata future The future handle (see @{bridge.future}).
+ * @return The value, or `nil` and the error message.
+ * @raise Throws an error if Argument 1 is not lightuserdata, if not called in a coroutine of the GUI thread, or if the future already has a callback or waiting coroutine or has been consumed.
+ */
+static int await(lua_State* L) {
+  Future* future = checkPendingFuture(L, "await");
+  if (future->done) {
+    int n = pushCompletion(L, future);
+    dropFuture(future->handle); // consumed
+    return n;
+  }
+  if (!lua_isyieldable(L)) {
+    return luaL_error(L, "wxLanesBridge: await() must be called in a coroutine.");
+  }
+  lua_pushthread(L);
+  setCallback(L, future);
+  return lua_yield(L, 0);
+}
+
+/**
+ * Creates a mailbox for sending commands from the GUI thread to lanes.
+ *
+ * The bridge otherwise only delivers data from the lanes to the GUI thread. A 
+ * mailbox is the way back, e.g. for cancel or pause requests and new 
+ * parameters: the GUI thread (or any other thread) puts records into it via 
+ * @{bridge.send}, and lanes wait for them via @{bridge.receive} or check 
+ * @{bridge.pending}, which costs a few atomic operations and no lock, in their 
+ * inner loops. A waiting lane is woken immediately, so a command takes effect 
+ * without polling a linda.
+ *
+ * The returned handle is lightuserdata and can be passed to lanes. Once the 
+ * mailbox is closed (see @{bridge.mailboxClose}), the handle is dead: sending 
+ * fails and receiving returns nil, so lanes may keep it safely.
+ *
+ * @function bridge.mailbox
+ * @treturn lightuserdata Handle of the mailbox.
+ * @raise Throws an error if too many mailboxes are open.
+ * @usage
+ * -- In main GUI thread
+ * local mbox = bridge.mailbox()
+ * local lane = lanes.gen("*", worker)(bridge.getPointer(frame), mbox)
+ * cancelButton:Connect(wx.wxEVT_BUTTON, function() bridge.send(mbox, { s = "cancel" }) end)
+ *
+ * -- In worker lane
+ * for n = 1, total do
+ *   if bridge.pending(mbox) > 0 and bridge.receive(mbox, 0).s == "cancel" then break end
+ *   -- ...
+ * end
+ */
+static int mailbox(lua_State* L) {
+  Mailbox* mbox = new Mailbox();
+  void* h = objects().add(mbox, OBJECT_MAILBOX);
+  if (!h) {
+    mbox->release();
+    return luaL_error(L, "wxLanesBridge: Too many mailboxes.");
+  }
+  lua_pushlightuserdata(L, h);
+  return 1;
+}
+
+static void* checkMailbox(lua_State* L, int idx) {
+  luaL_checktype(L, idx, LUA_TLIGHTUSERDATA);
+  return lua_touserdata(L, idx);
+}
+
+/**
+ * Sends one record to a mailbox.
+ *
+ * Wakes a lane waiting in @{bridge.receive}. Records are received in the order
+ * they were sent.
+ *
+ * @function bridge.send
+ * @tparam lightuserdata mbox The mailbox handle (see @{bridge.mailbox}).
+ * @tparam[opt] table data Optional data table with the fields `s`, `i`, `l`, `b`, `value` and `buffer` as in @{bridge.postEvent}.
+ * @treturn boolean `true` on success, `false` if the mailbox has been closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ * @usage
+ * bridge.send(mbox, { s = "params", value = { gain = 2.5, offset = 0 } })
+ */
+static int mailboxSend(lua_State* L) {
+  void* handle = checkMailbox(L, 1);
+  Record rec;
+  if (lua_istable(L, 2)) readRecord(L, 2, rec);
+  bool ok = false;
+  ObjectUse<Mailbox> use(handle, OBJECT_MAILBOX);
+  Mailbox* mbox = use.get();
+  if (mbox) {
+    std::lock_guard<std::mutex> lock(mbox->mutex);
+    ok = !mbox->closed;
+    if (ok) {
+      mbox->queue.push_back(Record());
+      std::swap(mbox->queue.back(), rec);
+      mbox->count.fetch_add(1, std::memory_order_release);
+    }
+  }
+  if (ok) mbox->ready.notify_one();
+  lua_pushboolean(L, ok);
+  return 1;
+}
+
+/**
+ * Receives the oldest record of a mailbox.
+ *
+ * Waits for a record if the mailbox is empty, at most `timeout` milliseconds.
+ * A timeout of 0 only checks for a record. Called from the GUI thread, this 
+ * function never waits.
+ *
+ * @function bridge.receive
+ * @tparam lightuserdata mbox The mailbox handle (see @{bridge.mailbox}).
+ * @tparam[opt] number timeout Maximum wait in milliseconds. Waits indefinitely if omitted.
+ * @treturn table|nil The record `{ s = ..., i = ..., l = ... }` as in @{bridge.getBatch}, or nil if none arrived in time or the mailbox has been closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ * @usage
+ * -- In worker lane: idle until the GUI thread sends new parameters
+ * local cmd = bridge.receive(mbox)
+ */
+static int mailboxReceive(lua_State* L) {
+  void* handle = checkMailbox(L, 1);
+  lua_Number timeout = luaL_optnumber(L, 2, -1);
+  if (std::this_thread::get_id() == s_guiThread) timeout = 0;
+
+  Mailbox* mbox;
+  {
+    ObjectUse<Mailbox> use(handle, OBJECT_MAILBOX);
+    mbox = use.get();
+    if (!mbox) return 0; // closed
+    // Fast path: nothing to receive and no wait
+    if (timeout == 0 && mbox->count.load(std::memory_order_acquire) == 0) return 0;
+    // Keep the mailbox alive while waiting, even if it is closed meanwhile
+    mbox->addRef();
+  }
+  Record rec;
+  bool received = false;
+  {
+    std::unique_lock<std::mutex> lock(mbox->mutex);
+    auto arrived = [mbox] { return mbox->closed || !mbox->queue.empty(); };
+    if (timeout < 0) {
+      mbox->ready.wait(lock, arrived);
+    }
+    else if (timeout > 0) {
+      mbox->ready.wait_for(lock, std::chrono::duration<double, std::milli>(timeout), arrived);
+    }
+    if (!mbox->closed && !mbox->queue.empty()) {
+      std::swap(rec, mbox->queue.front());
+      mbox->queue.pop_front();
+      mbox->count.fetch_sub(1, std::memory_order_relaxed);
+      received = true;
+    }
+  }
+  mbox->release();
+  if (!received) return 0;
+  pushRecord(L, rec);
+  return 1;
+}
+
+/**
+ * Returns the number of records waiting in a mailbox.
+ *
+ * Costs a few atomic operations and takes no lock, so lanes can call it in 
+ * their inner loops.
+ *
+ * @function bridge.pending
+ * @tparam lightuserdata mbox The mailbox handle (see @{bridge.mailbox}).
+ * @treturn integer Number of records waiting, 0 if the mailbox has been closed.
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ */
+static int mailboxPending(lua_State* L) {
+  ObjectUse<Mailbox> use(checkMailbox(L, 1), OBJECT_MAILBOX);
+  Mailbox* mbox = use.get();
+  lua_pushinteger(L, mbox ? (lua_Integer)mbox->count.load(std::memory_order_acquire) : 0);
+  return 1;
+}
+
+/**
+ * Closes a mailbox.
+ *
+ * Kills the handle returned by @{bridge.mailbox}. Lanes waiting in 
+ * @{bridge.receive} return nil; records not yet received are discarded. From 
+ * then on, @{bridge.send} returns false, @{bridge.receive} nil and 
+ * @{bridge.pending} 0 for the handle. Closing it again does nothing.
+ *
+ * @function bridge.mailboxClose
+ * @tparam lightuserdata mbox The mailbox handle (see @{bridge.mailbox}).
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ */
+static int mailboxClose(lua_State* L) {
+  Mailbox* mbox = removeObject<Mailbox>(checkMailbox(L, 1), OBJECT_MAILBOX);
+  if (!mbox) return 0; // closed before
+  {
+    std::lock_guard<std::mutex> lock(mbox->mutex);
+    mbox->closed = true;
+    mbox->queue.clear();
+    mbox->count.store(0);
+  }
+  mbox->ready.notify_all();
+  mbox->release();
+  return 0;
+}
+
+/**
+ * Creates a bridge-owned binary buffer.
+ *
+ * Buffers carry large binary data (image tiles, sample arrays, ...) from lanes
+ * to the GUI thread without copying. A buffer is attached to an event via the
+ * `buffer` field of the data table of @{bridge.postEvent} (or of a record of
+ * @{bridge.postEventBatch}, @{bridge.postLatest} and @{bridge.ringPush}). 
+ * Every post takes a reference of its own, so the handle stays valid however
+ * the post ends (queued, dropped or rejected) and can be posted any number of
+ * times; the lane releases it via @{bridge.bufferRelease} when done. As the 
+ * memory is shared, it must not be written after the first post. The GUI 
+ * thread gets a view of the very same memory via @{bridge.getBuffer} or the 
+ * `buffer` field of the records returned by @{bridge.getBatch}. The memory is 
+ * freed when the handle, the last event and the last view referring to it are
+ * gone.
+ *
+ * The buffer is either created with a given size and filled via 
+ * @{bridge.bufferWrite} or in place by C code (see @{bridge.bufferPointer}), 
+ * or directly from a Lua string.
  *
- * This function resolves the 
- * discrepancy by injecting the correct ID from the main GUI thread into the 
- * bridge's shared memory. It must be called once before any lane attempts 
- * to use the bridge, ideally immediately after the initial `require` statement, 
- * as shown in the usage example.
- * @function bridge.init
- * @tparam integer id The runtime-defined `wxEVT_THREAD` ID from wxLua.
- * @treturn table self The bridge module table to allow for method chaining.
+ * @function bridge.buffer
+ * @tparam integer|string init Size of the buffer in bytes, or a string whose bytes are copied into the buffer.
+ * @treturn lightuserdata Handle of the buffer.
+ * @raise Throws an error if Argument 1 is neither a number nor a string, or if out of memory.
  * @usage
+ * -- In worker lane
+ * local buf = bridge.buffer(tileData)
+ * bridge.postEvent(objPtr, { i = tileIndex, buffer = buf })
+ * bridge.bufferRelease(buf)
+ *
  * -- In main GUI thread
- * local wx = require("wx")
- * local bridge = require("wxLanesBridge").init(wx.wxEVT_THREAD)
+ * frame:Connect(wx.wxEVT_THREAD, function(event)
+ *   local view = bridge.getBuffer(event)
+ *   local bytes = view:string(1, 16)
+ * end)
+ */
+static int buffer(lua_State* L) {
+  Buffer* buf;
+  if (lua_type(L, 1) == LUA_TSTRING) {
+    size_t len;
+    const char* str = lua_tolstring(L, 1, &len);
+    buf = Buffer::create(len);
+    if (buf) memcpy(buf->data(), str, len);
+  }
+  else {
+    lua_Integer size = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+    buf = Buffer::create((size_t)size);
+    if (buf) memset(buf->data(), 0, (size_t)size);
+  }
+  if (!buf) return luaL_error(L, "wxLanesBridge: Out of memory.");
+  void* h = objects().add(buf, OBJECT_BUFFER);
+  if (!h) {
+    buf->release();
+    return luaL_error(L, "wxLanesBridge: Too many buffers.");
+  }
+  lua_pushlightuserdata(L, h);
+  return 1;
+}
+
+// Refers to the buffer behind argument idx: a live buffer handle or a buffer
+// view. Raises a Lua error otherwise, so it is to be called after all other 
+// argument checks.
+static void checkBuffer(lua_State* L, int idx, Ref<Buffer>& buffer) {
+  Buffer* buf = NULL;
+  if (lua_islightuserdata(L, idx)) {
+    buf = acquire<Buffer>(lua_touserdata(L, idx), OBJECT_BUFFER);
+    if (!buf) luaL_argerror(L, idx, "buffer handle is closed or no buffer handle");
+  }
+  else {
+    Buffer** view = (Buffer**)luaL_testudata(L, idx, BUFFER_VIEW);
+    if (!view) luaL_argerror(L, idx, "buffer handle or view expected");
+    buf = *view;
+    buf->addRef();
+  }
+  Ref<Buffer>(buf).swap(buffer);
+}
+
+/**
+ * Copies a string into a buffer.
  *
- * -- In worker thread (static ID is already shared in process memory)
- * local bridge = require("wxLanesBridge")
+ * @function bridge.bufferWrite
+ * @tparam lightuserdata buf The buffer handle (see @{bridge.buffer}).
+ * @tparam integer pos Position of the first byte to write (1-based).
+ * @tparam string data The bytes to write.
+ * @treturn nil
+ * @raise Throws an error if the handle has been released or the data does not fit into the buffer.
  */
-static int init(lua_State* L) {
-  // 1. Extract the Event ID from the first argument and store it.
-  //    This static value is shared across the entire process (and all lanes)
-  //    because that's how static variables in a DLL behave.
-  s_defaultEventID = (wxEventType)luaL_checkinteger(L, 1);
+static int bufferWrite(lua_State* L) {
+  lua_Integer pos = luaL_checkinteger(L, 2);
+  size_t len;
+  const char* str = luaL_checklstring(L, 3, &len);
+  Ref<Buffer> buf;
+  checkBuffer(L, 1, buf);
+  bool fits = pos >= 1 && (size_t)(pos - 1) + len <= buf->size();
+  if (fits) memcpy(buf->data() + (pos - 1), str, len);
+  buf.reset(); // before raising
+  luaL_argcheck(L, fits, 2, "out of buffer range");
+  return 0;
+}
+
+/**
+ * Returns the address and size of a buffer's memory.
+ *
+ * Allows C modules to fill a buffer in place or to read it
+ * without copying. The address is valid as long as the buffer handle or view 
+ * is.
+ *
+ * @function bridge.bufferPointer
+ * @tparam lightuserdata|userdata buf The buffer handle (see @{bridge.buffer}) or a buffer view (see @{bridge.getBuffer}).
+ * @treturn lightuserdata Address of the first byte.
+ * @treturn integer Size in bytes.
+ * @raise Throws an error if Argument 1 is neither a live buffer handle nor a view.
+ */
+static int bufferPointer(lua_State* L) {
+  Ref<Buffer> buf;
+  checkBuffer(L, 1, buf);
+  lua_pushlightuserdata(L, buf->data());
+  lua_pushinteger(L, (lua_Integer)buf->size());
+  return 2;
+}
+
+/**
+ * Releases a buffer handle.
+ *
+ * Kills the handle returned by @{bridge.buffer}. The memory is freed once no 
+ * event or view refers to it anymore. From then on, posting the handle and 
+ * the buffer functions raise an error for it; releasing it again does nothing.
+ *
+ * @function bridge.bufferRelease
+ * @tparam lightuserdata buf The buffer handle (see @{bridge.buffer}).
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not lightuserdata.
+ */
+static int bufferRelease(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+  Buffer* buf = removeObject<Buffer>(lua_touserdata(L, 1), OBJECT_BUFFER);
+  if (buf) buf->release();
+  return 0;
+}
 
-  // 2. Return the module table to Lua to allow for chaining.
-  //    First, try to find the module in the global table.
-  lua_getglobal(L, "wxLanesBridge"); 
+/**
+ * Returns a view of the binary buffer attached to an event.
+ *
+ * To be called in the GUI thread from within the event handler of an event
+ * sent via @{bridge.postEvent} with a `buffer` field. The view refers to the 
+ * buffer memory written by the lane; no data is copied. It supports the 
+ * following methods:
+ *
+ * - `view:size()` (or `#view`) returns the size in bytes.
+ * - `view:string([i [, j]])` returns bytes i to j as Lua string (same indexing as `string.sub`).
+ * - `view:pointer()` returns the address of the memory as lightuserdata, e.g. for C modules.
+ *
+ * @function bridge.getBuffer
+ * @tparam userdata event The event object passed to the wxLua event handler.
+ * @treturn userdata|nil The buffer view, or nil if no buffer is attached.
+ * @raise Throws an error if Argument 1 is not an event.
+ */
+static int getBuffer(lua_State* L) {
+  BridgeEvent* event = dynamic_cast<BridgeEvent*>(checkEvent(L, 1));
+  if (!event || !event->GetBuffer().get()) return 0;
+  pushBufferView(L, event->GetBuffer());
+  return 1;
+}
 
-  // 3. If it's not global (common in Lua 5.2+), fetch it from the package.loaded table.
-  if (lua_isnil(L, -1)) {
-    lua_pop(L, 1); // Remove the nil
-    lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
-    lua_getfield(L, -1, "wxLanesBridge");
-    lua_remove(L, -2); // Remove the _LOADED table, leaving the module on top
+/**
+ * Returns the raw bytes attached to an event.
+ *
+ * To be called in the GUI thread from within the event handler of an event
+ * sent via @{bridge.postEvent} with a `b` field. Unlike `data.s`, which is 
+ * converted to a wxString and back, the bytes arrive exactly as they were 
+ * sent, so this is the slot for binary data (or for text where the conversion
+ * cost matters). Compressed bytes (see @{bridge.registerChannel}) are 
+ * decompressed on each call.
+ *
+ * @function bridge.getBytes
+ * @tparam userdata event The event object passed to the wxLua event handler.
+ * @treturn string|nil The bytes, or nil if the event carries none.
+ * @raise Throws an error if Argument 1 is not an event.
+ * @usage
+ * -- In worker lane
+ * bridge.postEvent(objPtr, { b = string.pack("<I4d", id, value) })
+ *
+ * -- In main GUI thread
+ * local id, value = string.unpack("<I4d", bridge.getBytes(event))
+ */
+static int getBytes(lua_State* L) {
+  BridgeEvent* event = dynamic_cast<BridgeEvent*>(checkEvent(L, 1));
+  if (!event || !event->GetBytes().get()) return 0;
+  const Ref<Buffer>& bytes = event->GetBytes();
+  if (event->GetCompressed() & COMPRESSED_B) {
+    pushDecompressed(L, (const char*)bytes->data(), bytes->size());
+  }
+  else {
+    lua_pushlstring(L, (const char*)bytes->data(), bytes->size());
   }
+  return 1;
+}
 
-  // Return 1 value (the module table)
-  return 1;   
+/**
+ * Packs a Lua value into a compact binary string.
+ *
+ * Supports nil, booleans, integers, floats, strings, lightuserdata and tables
+ * of these, nested up to 100 levels. Metatables are not packed and tables
+ * referenced several times are packed several times. This is the format used
+ * for the `value` field of @{bridge.postEvent}; it is provided separately for 
+ * other transports (e.g. a linda) or for storing values.
+ *
+ * @function bridge.pack
+ * @param value The value to pack.
+ * @treturn string The packed value.
+ * @raise Throws an error if the value contains unsupported types (functions, userdata, threads) or is nested too deep (or cyclic).
+ */
+static int pack(lua_State* L) {
+  luaL_checkany(L, 1);
+  const std::string& packed = packScratch(L, 1);
+  lua_pushlstring(L, packed.data(), packed.size());
+  return 1;
 }
 
 /**
- * Extracts the raw C++ memory address from a wxLua userdata object.
+ * Rebuilds a packed Lua value.
  *
- * This function is essential for cross-thread communication with Lua Lanes. 
- * Since complex wxLua userdata objects cannot be safely shared between threads 
- * (Lanes), this function converts them into 'lightuserdata' (a raw C pointer).
+ * In the GUI thread this takes the event object of an event sent via 
+ * @{bridge.postEvent} with a `value` field and returns that value; tables are
+ * rebuilt directly from the binary representation. Alternatively a string 
+ * created by @{bridge.pack} is unpacked.
  *
- * @function bridge.getPointer
- * @tparam userdata obj The wxLua object (e.g., a wxWindow, wxFrame, or wxButton).
- * @treturn lightuserdata|nil The raw C++ pointer address, or nil if the extraction fails.
- * @raise Throws an error if the bridge has not been initialized via @{bridge.init}.
+ * @function bridge.unpack
+ * @tparam userdata|string event The event object passed to the wxLua event handler, or a packed string.
+ * @return The unpacked value (nil if the event carries no value).
+ * @raise Throws an error if Argument 1 is neither an event nor a string, or if the packed data is corrupt.
  * @usage
- * -- Get a thread-safe pointer to pass into a Lane
- * local frame = wx.wxFrame(wx.NULL, wx.wxID_ANY, "My Frame")
- * local ptr = bridge.getPointer(frame)
- * -- The 'ptr' can now be safely passed as an argument to a lane function.
+ * -- In worker lane
+ * bridge.postEvent(objPtr, { i = jobId, value = { name = "run 7", samples = { 1.5, 2.25, 3 } } })
+ *
+ * -- In main GUI thread
+ * frame:Connect(wx.wxEVT_THREAD, function(event)
+ *   local result = bridge.unpack(event)
+ *   print(result.name, #result.samples)
+ * end)
  */
-static int getPointer(lua_State* L) {
-  if (s_defaultEventID == wxID_ANY) {
-    // throw an error as early as possible if wxLanesBridge is not initalized
-    return luaL_error(L, "wxLanesBridge must be initialized before use.");
+static int unpack(lua_State* L) {
+  if (lua_type(L, 1) == LUA_TSTRING) {
+    size_t len;
+    const char* str = lua_tolstring(L, 1, &len);
+    unpackValue(L, str, len);
+    return 1;
   }
-  if (lua_isuserdata(L, 1)) {
-    // wxLua userdata blocks contain the pointer to the C++ object at the very beginning.
-    // ud is the address of the pointer
-    void* ud = lua_touserdata(L, 1);
-    if (ud) {
-      // Dereference the userdata block to get the actual C++ object address.
-      // Push it as lightuserdata, which is a plain pointer value and Lane-safe.
-      lua_pushlightuserdata(L, *(void**)ud);
-      return 1;
-    }
+  BridgeEvent* event = dynamic_cast<BridgeEvent*>(checkEvent(L, 1));
+  if (!event || !event->GetValue().get()) return 0;
+  const Ref<Buffer>& value = event->GetValue();
+  unpackValue(L, (const char*)value->data(), value->size());
+  return 1;
+}
+
+// Buffer view methods
+static int viewSize(lua_State* L) {
+  Buffer* buf = *(Buffer**)luaL_checkudata(L, 1, BUFFER_VIEW);
+  lua_pushinteger(L, (lua_Integer)buf->size());
+  return 1;
+}
+
+static int viewString(lua_State* L) {
+  Buffer* buf = *(Buffer**)luaL_checkudata(L, 1, BUFFER_VIEW);
+  lua_Integer size = (lua_Integer)buf->size();
+  lua_Integer i = luaL_optinteger(L, 2, 1);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+  // Same index rules as string.sub()
+  if (i < 0) i = (-i > size) ? 1 : size + i + 1;
+  if (j < 0) j = size + j + 1;
+  if (i < 1) i = 1;
+  if (j > size) j = size;
+  if (i > j) lua_pushliteral(L, "");
+  else lua_pushlstring(L, (const char*)buf->data() + (i - 1), (size_t)(j - i + 1));
+  return 1;
+}
+
+static int viewPointer(lua_State* L) {
+  Buffer* buf = *(Buffer**)luaL_checkudata(L, 1, BUFFER_VIEW);
+  lua_pushlightuserdata(L, buf->data());
+  return 1;
+}
+
+static int viewGc(lua_State* L) {
+  Buffer** view = (Buffer**)luaL_checkudata(L, 1, BUFFER_VIEW);
+  if (*view) (*view)->release();
+  *view = NULL;
+  return 0;
+}
+
+static const luaL_Reg view_funcs[] = {
+  {"size", viewSize},
+  {"string", viewString},
+  {"pointer", viewPointer},
+  {NULL, NULL}
+};
+
+// Sets field name of the table on top of the stack to the counters of a pool
+static void pushPoolStats(lua_State* L, const char* name, unsigned long long hits,
+                          unsigned long long misses, size_t available) {
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, (lua_Integer)hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushinteger(L, (lua_Integer)misses);
+  lua_setfield(L, -2, "misses");
+  lua_pushinteger(L, (lua_Integer)available);
+  lua_setfield(L, -2, "free");
+  lua_setfield(L, -2, name);
+}
+
+/**
+ * Returns the statistics of the bridge's object pools.
+ *
+ * Events, batch payloads and value payloads are recycled after the GUI thread 
+ * has handled them instead of being freed. A hit is an allocation served from 
+ * a pool, a miss one that needed the heap.
+ *
+ * @function bridge.poolStats
+ * @treturn table `{ events = { hits=..., misses=..., free=... }, payloads = {...}, values = {...} }`
+ * @usage
+ * local stats = bridge.poolStats()
+ * print("event pool hit rate", stats.events.hits / (stats.events.hits + stats.events.misses))
+ */
+static int poolStats(lua_State* L) {
+  BlockPool& events = BridgeEvent::pool();
+  Recycler<BatchPayload>& payloads = BatchPayload::recycler();
+  Recycler<ValuesPayload>& values = ValuesPayload::recycler();
+  lua_createtable(L, 0, 3);
+  pushPoolStats(L, "events", events.hits.load(), events.misses.load(), events.available());
+  pushPoolStats(L, "payloads", payloads.hits.load(), payloads.misses.load(), payloads.available());
+  pushPoolStats(L, "values", values.hits.load(), values.misses.load(), values.available());
+  return 1;
+}
+
+/**
+ * Enables or disables detailed statistics.
+ *
+ * The bridge-wide counters of @{bridge.stats} are always maintained. Per-target 
+ * counters and the latency histogram are only collected while enabled, as 
+ * they take a lock and a clock read per event.
+ *
+ * @function bridge.enableStats
+ * @tparam boolean enable `true` to enable, `false` to disable.
+ * @treturn nil
+ */
+static int enableStats(lua_State* L) {
+  stats().enabled.store(lua_toboolean(L, 1) != 0);
+  return 0;
+}
+
+// Returns the latency in microseconds below which the given fraction of all 
+// tracked events fall (upper bucket bound), or 0 if nothing has been tracked
+static lua_Integer latencyPercentile(const unsigned long long* buckets, 
+                                     unsigned long long count, double fraction) {
+  if (!count) return 0;
+  unsigned long long limit = (unsigned long long)(fraction * (double)count);
+  if (limit < 1) limit = 1;
+  unsigned long long sum = 0;
+  for (int n = 0; n < LATENCY_BUCKETS; n++) {
+    sum += buckets[n];
+    if (sum >= limit) return (lua_Integer)1 << n;
   }
-  return 0; // Return nil if extraction fails
+  return (lua_Integer)1 << (LATENCY_BUCKETS - 1);
 }
 
 /**
- * Posts a wxThreadEvent to the main GUI thread.
- * 
- * This function sends an event to the specified wxWidgets object pointer. It requires 
- * the bridge to be initialized via @{bridge.init}. The optional data table allows passing 
- * additional information to the event handler in the GUI thread.
+ * Returns the bridge statistics.
  *
- * @function bridge.postEvent
- * @tparam lightuserdata objPtr The pointer to the target wxLua object (received from the GUI thread).
- * @tparam[opt] table data Optional data table to populate the event fields:
- * @tparam[opt] string data.s Maps to `event:SetString()` (UTF-8 supported).
- * @tparam[opt] integer data.i Maps to `event:SetInt()` (standard command integer).
- * @tparam[opt] integer data.l Maps to `event:SetExtraLong()` (useful for timestamps or 32-bit IDs).
+ * Events are counted when they are queued and when the GUI thread has handled
+ * them. An event counts as handled when @{bridge.markHandled} is called for it,
+ * or at the latest when wxWidgets deletes it after the handler has returned. 
+ * Records are the data units sent by the lanes; several records may share one 
+ * event (batches, rings, paced targets). The returned table contains:
+ *
+ * - `events`, `handled`, `inflight`: bridge events queued, handled and still queued.
+ * - `records`, `bytes`: records sent and the size of their data in bytes.
+ * - `dropped`: records dropped or rejected by the bounded queue of a target.
+ * - `latency`: post-to-handle latency of the events queued while detailed 
+ *   statistics were enabled, with `count`, `p50`, `p90`, `p99` (in microseconds,
+ *   as upper bound of a power-of-two bucket) and `histogram`, where entry n 
+ *   counts the latencies below 2^(n-1) microseconds.
+ * - `targets`: table indexed by target pointer with `events`, `handled`, 
+ *   `inflight`, `records`, `bytes` and `dropped` per target (collected while enabled).
+ *
+ * @function bridge.stats
+ * @treturn table The statistics.
+ * @usage
+ * bridge.enableStats(true)
+ * -- ...
+ * local st = bridge.stats()
+ * print(st.inflight, st.latency.p50, st.latency.p99)
+ * local own = st.targets[bridge.getPointer(frame)]
+ */
+static int getStats(lua_State* L) {
+  Stats& st = stats();
+  unsigned long long events = st.events.load();
+  unsigned long long handled = st.handled.load();
+  lua_createtable(L, 0, 8);
+  lua_pushinteger(L, (lua_Integer)events);
+  lua_setfield(L, -2, "events");
+  lua_pushinteger(L, (lua_Integer)handled);
+  lua_setfield(L, -2, "handled");
+  lua_pushinteger(L, (lua_Integer)(events > handled ? events - handled : 0));
+  lua_setfield(L, -2, "inflight");
+  lua_pushinteger(L, (lua_Integer)st.records.load());
+  lua_setfield(L, -2, "records");
+  lua_pushinteger(L, (lua_Integer)st.bytes.load());
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, (lua_Integer)st.dropped.load());
+  lua_setfield(L, -2, "dropped");
+
+  // Latency histogram
+  unsigned long long buckets[LATENCY_BUCKETS];
+  unsigned long long count = 0;
+  for (int n = 0; n < LATENCY_BUCKETS; n++) {
+    buckets[n] = st.latency[n].load();
+    count += buckets[n];
+  }
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, (lua_Integer)count);
+  lua_setfield(L, -2, "count");
+  lua_pushinteger(L, latencyPercentile(buckets, count, 0.5));
+  lua_setfield(L, -2, "p50");
+  lua_pushinteger(L, latencyPercentile(buckets, count, 0.9));
+  lua_setfield(L, -2, "p90");
+  lua_pushinteger(L, latencyPercentile(buckets, count, 0.99));
+  lua_setfield(L, -2, "p99");
+  lua_createtable(L, LATENCY_BUCKETS, 0);
+  for (int n = 0; n < LATENCY_BUCKETS; n++) {
+    lua_pushinteger(L, (lua_Integer)buckets[n]);
+    lua_rawseti(L, -2, n + 1);
+  }
+  lua_setfield(L, -2, "histogram");
+  lua_setfield(L, -2, "latency");
+
+  // Per target
+  std::map<void*, TargetStats> targets;
+  {
+    std::lock_guard<std::mutex> lock(st.mutex);
+    targets = st.targets;
+  }
+  lua_createtable(L, 0, (int)targets.size());
+  for (std::map<void*, TargetStats>::const_iterator it = targets.begin(); it != targets.end(); ++it) {
+    const TargetStats& target = it->second;
+    lua_pushlightuserdata(L, it->first);
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, (lua_Integer)target.events);
+    lua_setfield(L, -2, "events");
+    lua_pushinteger(L, (lua_Integer)target.handled);
+    lua_setfield(L, -2, "handled");
+    lua_pushinteger(L, (lua_Integer)(target.events > target.handled ? target.events - target.handled : 0));
+    lua_setfield(L, -2, "inflight");
+    lua_pushinteger(L, (lua_Integer)target.records);
+    lua_setfield(L, -2, "records");
+    lua_pushinteger(L, (lua_Integer)target.bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, (lua_Integer)target.dropped);
+    lua_setfield(L, -2, "dropped");
+    lua_rawset(L, -3);
+  }
+  lua_setfield(L, -2, "targets");
+  return 1;
+}
+
+/**
+ * Resets all counters of @{bridge.stats}.
+ *
+ * @function bridge.resetStats
  * @treturn nil
- * @raise Throws an error if Argument 1 is not lightuserdata, Argument 2 is not a table, or if the bridge has not been initialized.
+ */
+static int resetStats(lua_State* L) {
+  (void)L;
+  stats().reset();
+  return 0;
+}
+
+/**
+ * Marks an event as handled for the latency statistics.
+ *
+ * By default an event counts as handled when wxWidgets deletes it after the
+ * handler has returned. Call this function in the handler to take the time 
+ * at a specific point instead, e.g. before a long repaint.
+ *
+ * @function bridge.markHandled
+ * @tparam userdata event The event object passed to the wxLua event handler.
+ * @treturn nil
+ * @raise Throws an error if Argument 1 is not an event.
+ */
+static int markHandled(lua_State* L) {
+  BridgeEvent* event = dynamic_cast<BridgeEvent*>(checkEvent(L, 1));
+  if (event) event->MarkHandled();
+  return 0;
+}
+
+/**
+ * Enables or disables tracing.
+ *
+ * While enabled, the bridge records posts, the time events are queued until 
+ * handled, @{bridge.getBatch} calls and drain iterations (see @{bridge.drain})
+ * into per-thread buffers, with thread, target, payload size and timestamps. 
+ * Write them out via @{bridge.dumpTrace}. While disabled, tracing costs a 
+ * single branch per trace point.
+ *
+ * @function bridge.enableTrace
+ * @tparam boolean enable `true` to enable tracing.
+ * @tparam[opt=65536] integer capacity Maximum number of records kept per thread; further records are counted as lost.
+ * @treturn nil
+ * @raise Throws an error if the capacity is not positive.
  * @usage
- * -- Example: Sending a complex update from a worker lane
- * bridge.postEvent(objPtr, { 
- *     s = "Calculation finished", 
- *     i = 100, 
- *     l = os.time() 
- * })
+ * bridge.enableTrace(true)
+ * -- ... reproduce the jank ...
+ * bridge.dumpTrace("bridge-trace.json") -- open in chrome://tracing or Perfetto
+ */
+static int enableTrace(lua_State* L) {
+  bool enable = lua_toboolean(L, 1) != 0;
+  lua_Integer capacity = luaL_optinteger(L, 2, 65536);
+  luaL_argcheck(L, capacity > 0, 2, "capacity must be positive");
+  if (enable) {
+    s_traceCapacity.store((size_t)capacity);
+    if (!s_tracing.load()) s_traceEpoch = Clock::now();
+  }
+  s_tracing.store(enable);
+  return 0;
+}
+
+/**
+ * Writes the trace records to a file in Chrome trace format.
  *
- * -- Example: Just triggering the event ("ringing the doorbell")
- * bridge.postEvent(objPtr)
+ * The JSON file can be opened in `chrome://tracing`, Edge or Perfetto. Posts 
+ * appear as instants on the posting threads, the other records as spans. 
+ * The written records are removed from the buffers, tracing stays enabled or
+ * disabled. To be called in the GUI thread.
+ *
+ * @function bridge.dumpTrace
+ * @tparam string path Name of the file to write.
+ * @treturn integer Number of records written, or nil and an error message if the file could not be written.
+ * @treturn integer Number of records lost because a buffer was full.
+ * @raise Throws an error if Argument 1 is not a string.
  */
-static int postEvent(lua_State* L) {
-  // Checck number of arguments (may be 1 or 2)
-  int numArgs = lua_gettop(L);
-  if (numArgs < 1 || numArgs > 2) {
-    return luaL_error(L, "wxLanesBridge: Wrong argument count.");
+static int dumpTrace(lua_State* L) {
+  const char* path = luaL_checkstring(L, 1);
+  std::vector<TraceBuffer*> buffers;
+  {
+    std::lock_guard<std::mutex> lock(s_traceMutex);
+    buffers = s_traceBuffers;
   }
+  FILE* file = fopen(path, "w");
+  if (!file) return luaL_fileresult(L, 0, path);
+  fputs("{\"traceEvents\":[\n", file);
+  const char* separator = "";
+  unsigned long long written = 0;
+  unsigned long long lost = 0;
+  for (size_t b = 0; b < buffers.size(); b++) {
+    TraceBuffer* buffer = buffers[b];
+    std::vector<TraceRecord> records;
+    {
+      std::lock_guard<std::mutex> lock(buffer->mutex);
+      records.swap(buffer->records);
+      lost += buffer->lost;
+      buffer->lost = 0;
+    }
+    if (records.empty()) continue;
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"name\":\"%s %u\"}}", separator, buffer->tid, 
+            buffer->gui ? "GUI thread" : "thread", buffer->tid);
+    separator = ",\n";
+    for (size_t n = 0; n < records.size(); n++) {
+      const TraceRecord& rec = records[n];
+      double ts = std::chrono::duration<double, std::micro>(rec.start - s_traceEpoch).count();
+      fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"bridge\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,",
+              separator, s_traceNames[rec.kind], buffer->tid, ts);
+      if (rec.dur < 0) fputs("\"ph\":\"i\",\"s\":\"t\",", file);
+      else fprintf(file, "\"ph\":\"X\",\"dur\":%.3f,", rec.dur / 1000.0);
+      fprintf(file, "\"args\":{\"target\":\"%p\",\"%s\":%llu}}", rec.target,
+              rec.kind == TRACE_POST ? "bytes" : "records", rec.size);
+    }
+    written += records.size();
+  }
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+  bool ok = !ferror(file);
+  if (fclose(file) != 0) ok = false;
+  if (!ok) return luaL_fileresult(L, 0, path);
+  lua_pushinteger(L, (lua_Integer)written);
+  lua_pushinteger(L, (lua_Integer)lost);
+  return 2;
+}
 
-  // Ensure the bridge was initialized
-  if (s_defaultEventID == wxID_ANY) {
-    return luaL_error(L, "wxLanesBridge: Error - Call init() before postEvent().");
+// Returns all configured targets, with a reference each
+static std::vector<Target*> listTargets() {
+  std::vector<Target*> targets;
+  std::lock_guard<std::mutex> lock(s_targetsMutex);
+  for (std::map<void*, Target*>::iterator it = s_targets.begin(); it != s_targets.end(); ++it) {
+    it->second->addRef();
+    targets.push_back(it->second);
   }
-  
-  // First (mandatory) argument must be lightuserdata
-  if (!lua_islightuserdata(L, 1)) {
-    return luaL_error(L, "wxLanesBridge: Argument 1 must be lightuserdata (e.g. a wxWindow pointer)");
+  return targets;
+}
+
+// Stops accepting posts and waits until no post is under way. Lanes blocked
+// on a full queue give up.
+static void closePosts() {
+  s_closed.store(true);
+  std::vector<Target*> targets = listTargets();
+  for (size_t n = 0; n < targets.size(); n++) {
+    {
+      // A lane about to wait sees s_closed, a waiting lane is notified
+      std::lock_guard<std::mutex> lock(targets[n]->mutex);
+    }
+    targets[n]->space.notify_all();
+    targets[n]->release();
   }
+  // Posts hold the guard for microseconds only
+  while (s_posting.load() != 0) std::this_thread::yield();
+}
 
-  // Second (optional) argument must be a tabel
-  if (numArgs == 2 && !lua_istable(L, 2)) {
-    return luaL_error(L, "wxLanesBridge: Optional argument 2 must be a table.");
+/**
+ * Stops accepting posts and delivers what is pending in the bridge.
+ *
+ * For a fast and bounded exit: from now on all posts are ignored, as if their
+ * targets had been destroyed, and lanes blocked on a full queue (see 
+ * @{bridge.configure}) give up. Posts under way are waited for, which takes 
+ * microseconds. Then the bridge delivers what it holds: pending native 
+ * operations and log sink text are applied, completed futures are handed to
+ * their callbacks, drained targets (see @{bridge.drain}) are drained until the
+ * timeout expires, and the records of the other configured targets are handed 
+ * to their windows right away, without waiting for the pacing interval. 
+ * Events already queued in wxWidgets are handled by the event loop as usual, 
+ * or deleted together with their window.
+ *
+ * To be called in the GUI thread, usually followed by @{bridge.shutdown} 
+ * before the windows are destroyed. Posts stay closed.
+ *
+ * @function bridge.flush
+ * @tparam[opt=1000] number timeout Time for draining targets in milliseconds.
+ * @treturn boolean `true` if everything was delivered, `false` if records of drained targets are left.
+ * @raise Throws an error if the timeout is negative.
+ * @usage
+ * frame:Connect(wx.wxEVT_CLOSE_WINDOW, function(event)
+ *   bridge.flush(200)
+ *   bridge.shutdown()
+ *   event:Skip()
+ * end)
+ */
+static int flushBridge(lua_State* L) {
+  lua_Number timeout = luaL_optnumber(L, 1, 1000);
+  luaL_argcheck(L, timeout >= 0, 1, "timeout must not be negative");
+  Clock::time_point deadline = Clock::now() + 
+    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(timeout));
+  closePosts();
+
+  t_flushing = true;
+  if (s_host) applyNativeOps();
+  {
+    std::lock_guard<std::mutex> lock(s_sinksMutex);
+    for (size_t n = 0; n < s_sinks.size(); n++) s_sinks[n]->flush();
   }
-  
-  // Get address of target widget to post the event to
-  wxWindow* win = (wxWindow*)lua_touserdata(L, 1);
-  if (!win) return 0; // Safety check
-  
-  // Create new event on C++ stack
-  wxThreadEvent event(s_defaultEventID, wxID_ANY);
+  if (s_guiState) takeCompletions();
+  bool left;
+  do {
+    left = false;
+    for (size_t n = 0; n < s_drained.size(); ) {
+      // The callback may end draining and thus release the target
+      Target* target = s_drained[n];
+      target->addRef();
+      size_t count = 0;
+      if (drainTarget(target, count)) left = true;
+      if (n < s_drained.size() && s_drained[n] == target) n++;
+      target->release();
+    }
+  } while (left && Clock::now() < deadline);
+  t_flushing = false;
 
-  // Optional argument 2: The data table { s="...", i=..., l=... }
-  // Table indices s, i, and l are aligned to the available wxWidgets
-  // member functions for an wxThreadEvent:
-  // void SetExtraLong(long extraLong);
-  // void SetInt(int intCommand);
-  // void SetString(const wxString &string);
-  if (lua_istable(L, 2)) {
-    // [s]tring
-    lua_getfield(L, 2, "s");
-    if (lua_isstring(L, -1)) {
-      event.SetString(wxString::FromUTF8(lua_tostring(L, -1)));
+  // Records of the other targets go out as one batch each
+  std::vector<Target*> targets = listTargets();
+  for (size_t n = 0; n < targets.size(); n++) {
+    Target* target = targets[n];
+    {
+      std::lock_guard<std::mutex> lock(target->mutex);
+      // A delivery event under way takes the records anyway, a pending
+      // pacer timer is taken over (see Target::onDue)
+      if (!target->dead && !target->drained && !target->queue.empty() &&
+          (!target->scheduled || target->paced)) {
+        target->scheduled = true;
+        target->paced = false;
+        postFlush(target);
+      }
     }
-    lua_pop(L, 1);	// pops the string or nil
+    target->release();
+  }
+  lua_pushboolean(L, !left);
+  return 1;
+}
 
-    // [i]nteger (intCommand)
-    lua_getfield(L, 2, "i");
-    if (lua_isnumber(L, -1)) {
-      event.SetInt((int)lua_tointeger(L, -1));
+/**
+ * Stops accepting posts and discards what is pending in the bridge.
+ *
+ * Posts are closed as by @{bridge.flush}. Then everything the bridge still 
+ * holds is discarded in bulk: the queues of configured targets (which are 
+ * unconfigured, ending drained delivery), urgent records, coalescing slots of 
+ * @{bridge.postLatest}, native operations, log sink text and completed futures
+ * not yet handed to the GUI thread. Callbacks and coroutines still waiting for
+ * a future are released without being called or resumed. After this no lane queues an event for any
+ * window, so the windows can be destroyed safely. Events already queued in 
+ * wxWidgets carry no records of these queues anymore. To be called in the GUI
+ * thread; the bridge cannot be used afterwards.
+ *
+ * @function bridge.shutdown
+ * @treturn table Numbers of discarded items: `records` (target queues), `urgent`, `latest`, `native`, `lines` (log sinks), `futures` (completed) and `waiting` (callbacks and coroutines of futures).
+ * @usage
+ * bridge.flush(200)
+ * local dropped = bridge.shutdown()
+ * if dropped.records > 0 then print("discarded " .. dropped.records .. " records") end
+ */
+static int shutdownBridge(lua_State* L) {
+  closePosts();
+  lua_Integer records = 0;
+  lua_Integer urgent = 0;
+  lua_Integer latest = 0;
+  lua_Integer native = 0;
+  lua_Integer lines = 0;
+  lua_Integer futures = 0;
+  lua_Integer waiting = 0;
+
+  // Configured targets, see forgetTarget()
+  std::map<void*, Target*> targets;
+  {
+    std::lock_guard<std::mutex> lock(s_targetsMutex);
+    targets.swap(s_targets);
+    s_configuredTargets.store(0);
+  }
+  for (std::map<void*, Target*>::iterator it = targets.begin(); it != targets.end(); ++it) {
+    Target* target = it->second;
+    {
+      std::lock_guard<std::mutex> lock(target->mutex);
+      records += (lua_Integer)target->queue.size();
+      target->queue.clear();
+      target->latest.clear();
+      target->base = 0;
+      target->dead = true;
     }
-    lua_pop(L, 1);	// pops the integer or nil
+    target->space.notify_all();
+  }
+  while (!s_drained.empty()) luaL_unref(L, LUA_REGISTRYINDEX, undrain(s_drained.back()));
+  for (std::map<void*, Target*>::iterator it = targets.begin(); it != targets.end(); ++it) {
+    it->second->release();
+  }
 
-    // [l]ong (extraLong)
-    lua_getfield(L, 2, "l");
-    if (lua_isnumber(L, -1)) {
-      event.SetExtraLong((long)lua_tointeger(L, -1));
+  {
+    std::lock_guard<std::mutex> lock(s_urgentMutex);
+    for (std::map<void*, UrgentQueue>::iterator it = s_urgent.begin(); it != s_urgent.end(); ++it) {
+      urgent += (lua_Integer)it->second.records.size();
     }
-    lua_pop(L, 1);	// pops the extraLong or nil
+    s_urgent.clear();
+    s_urgentPending.store(0);
   }
-  // Post event (wxWidgets will create an internal copy for the queue)
-  wxPostEvent(win, event);
-  
-  return 0;
+  {
+    std::lock_guard<std::mutex> lock(s_latestMutex);
+    latest = (lua_Integer)s_latestSlots.size();
+    s_latestSlots.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(s_nativeMutex);
+    native = (lua_Integer)s_nativeOps.size();
+    s_nativeOps.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(s_sinksMutex);
+    for (size_t n = 0; n < s_sinks.size(); n++) lines += (lua_Integer)s_sinks[n]->discard();
+  }
+  std::vector<Future*> completed;
+  {
+    std::lock_guard<std::mutex> lock(s_futuresMutex);
+    completed.swap(s_completed);
+  }
+  futures = (lua_Integer)completed.size();
+  for (size_t n = 0; n < completed.size(); n++) completed[n]->release(); // of the completing side
+  std::vector<Future*> unconsumed;
+  unconsumed.swap(s_waiting);
+  waiting = (lua_Integer)unconsumed.size();
+  for (size_t n = 0; n < unconsumed.size(); n++) {
+    Future* future = unconsumed[n];
+    luaL_unref(L, LUA_REGISTRYINDEX, future->callback);
+    future->callback = LUA_NOREF;
+    dropFuture(future->handle); // of the GUI side
+  }
+
+  lua_createtable(L, 0, 7);
+  lua_pushinteger(L, records);
+  lua_setfield(L, -2, "records");
+  lua_pushinteger(L, urgent);
+  lua_setfield(L, -2, "urgent");
+  lua_pushinteger(L, latest);
+  lua_setfield(L, -2, "latest");
+  lua_pushinteger(L, native);
+  lua_setfield(L, -2, "native");
+  lua_pushinteger(L, lines);
+  lua_setfield(L, -2, "lines");
+  lua_pushinteger(L, futures);
+  lua_setfield(L, -2, "futures");
+  lua_pushinteger(L, waiting);
+  lua_setfield(L, -2, "waiting");
+  return 1;
 }
 
 static const luaL_Reg bridge_funcs[] = {
   {"init", init},
+  {"registerChannel", registerChannel},
   {"getPointer", getPointer},
+  {"handle", handle},
+  {"invalidate", invalidate},
   {"postEvent", postEvent},
+  {"post", post},
+  {"postv", postv},
+  {"getValues", getValues},
+  {"postEventBatch", postEventBatch},
+  {"postLatest", postLatest},
+  {"postUrgent", postUrgent},
+  {"getBatch", getBatch},
+  {"group", group},
+  {"poster", poster},
+  {"configure", configure},
+  {"drain", drain},
+  {"setGaugeValue", setGaugeValue},
+  {"setLabel", setLabel},
+  {"setStatusText", setStatusText},
+  {"ring", ring},
+  {"ringPush", ringPush},
+  {"ringClose", ringClose},
+  {"logSink", logSink},
+  {"logLine", logLine},
+  {"logClose", logClose},
+  {"sharedArray", sharedArray},
+  {"arraySet", arraySet},
+  {"arrayBack", arrayBack},
+  {"arrayPublish", arrayPublish},
+  {"arrayFront", arrayFront},
+  {"arrayGet", arrayGet},
+  {"arrayClose", arrayClose},
+  {"workers", workers},
+  {"submit", submit},
+  {"workersClose", workersClose},
+  {"future", future},
+  {"fulfil", fulfil},
+  {"fail", fail},
+  {"onComplete", onComplete},
+  {"await", await},
+  {"mailbox", mailbox},
+  {"send", mailboxSend},
+  {"receive", mailboxReceive},
+  {"pending", mailboxPending},
+  {"mailboxClose", mailboxClose},
+  {"buffer", buffer},
+  {"bufferWrite", bufferWrite},
+  {"bufferPointer", bufferPointer},
+  {"bufferRelease", bufferRelease},
+  {"getBuffer", getBuffer},
+  {"getBytes", getBytes},
+  {"pack", pack},
+  {"unpack", unpack},
+  {"poolStats", poolStats},
+  {"enableStats", enableStats},
+  {"stats", getStats},
+  {"resetStats", resetStats},
+  {"markHandled", markHandled},
+  {"enableTrace", enableTrace},
+  {"dumpTrace", dumpTrace},
+  {"flush", flushBridge},
+  {"shutdown", shutdownBridge},
   {NULL, NULL}
 };
 
-extern "C" LUA_API int luaopen_wxLanesBridge(lua_State* L) {
-  luaL_newlib(L, bridge_funcs);
+extern "C" WXLANESBRIDGE_API int luaopen_wxLanesBridge(lua_State* L) {
+  // Metatable of buffer views
+  if (luaL_newmetatable(L, BUFFER_VIEW)) {
+    luaL_newlib(L, view_funcs);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, viewSize);
+    lua_setfield(L, -2, "__len");
+    lua_pushcfunction(L, viewGc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+
+  // The module table. Its functions share the upvalues of pushUpvalues().
+  luaL_newlibtable(L, bridge_funcs);
+  int module = lua_gettop(L);
+  pushUpvalues(L, module);
+  luaL_setfuncs(L, bridge_funcs, UPVALUE_COUNT);
   lua_pushliteral(L,_VERSION);
   lua_setfield(L,-2,"_VERSION");
+
+  // Metatable of target groups (whose methods read data tables as well)
+  if (luaL_newmetatable(L, TARGET_GROUP)) {
+    luaL_newlibtable(L, group_funcs);
+    pushUpvalues(L, module);
+    luaL_setfuncs(L, group_funcs, UPVALUE_COUNT);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, groupSize);
+    lua_setfield(L, -2, "__len");
+  }
+  lua_pop(L, 1);
+
+  // Metatable of posters. Their methods check the poster against it (upvalue 1).
+  if (luaL_newmetatable(L, POSTER)) {
+    luaL_newlibtable(L, poster_funcs);
+    lua_pushvalue(L, -2);
+    luaL_setfuncs(L, poster_funcs, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, posterGc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
   return 1;
 }